@@ -33,29 +33,10 @@ void update_cpu_gauge();
  */
 void update_memory_metrics();
 
-/**
- * @brief Actualiza la métrica de nivel de batería.
- */
-void update_battery_gauge();
-
-/**
- * @brief Actualiza la métrica de la temperatura de cpu.
- */
-void update_cpu_temp_gauge();
-
-/**
- * @brief Actualiza la métrica de la velocidad de la CPU.
- */
-void update_cpu_speed_gauge();
-
 /**
  * @brief Actualiza la métrica de sys calls.
  */
 void update_sys_calls_gauge();
-/**
- * @brief Actualiza la metrica de carga promedio
- */
-void update_avg_load_gauge();
 
 /**
  * @brief Actualiza la métrica de número de procesos en ejecución.
@@ -32,6 +32,7 @@ limitations under the License.
  * * [Counter](https://prometheus.io/docs/concepts/metric_types/#counter)
  * * [Gauge](https://prometheus.io/docs/concepts/metric_types/#gauge)
  * * [Histogram](https://prometheus.io/docs/concepts/metric_types/#histogram)
+ * * [Summary](https://prometheus.io/docs/concepts/metric_types/#summary)
  *
  * To get started using one of the metric types, declare the metric at file scope. For example:
  *
@@ -119,6 +120,7 @@ limitations under the License.
 #define PROM_INCLUDED
 
 #include "prom_alloc.h"
+#include "prom_batch.h"
 #include "prom_collector.h"
 #include "prom_collector_registry.h"
 #include "prom_counter.h"
@@ -130,5 +132,7 @@ limitations under the License.
 #include "prom_metric.h"
 #include "prom_metric_sample.h"
 #include "prom_metric_sample_histogram.h"
+#include "prom_metric_sample_summary.h"
+#include "prom_summary.h"
 
 #endif //  PROM_INCLUDED
\ No newline at end of file
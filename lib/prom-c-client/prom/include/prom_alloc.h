@@ -26,23 +26,90 @@ limitations under the License.
 #include <string.h>
 
 /**
- * @brief Redefine this macro if you wish to override it. The default value is malloc.
+ * @brief An allocator the library can be pointed at at runtime.
+ *
+ * Every function receives ctx as its first argument. free_fn may be a no-op for allocators, such as arenas, that
+ * release their memory all at once.
  */
-#define prom_malloc malloc
+typedef struct prom_allocator {
+  void *(*malloc_fn)(void *ctx, size_t size);              /**< Returns size bytes of uninitialized memory */
+  void *(*calloc_fn)(void *ctx, size_t count, size_t size); /**< Returns count * size bytes of zeroed memory */
+  void *(*realloc_fn)(void *ctx, void *ptr, size_t size);  /**< Resizes ptr, which may be NULL, to size bytes */
+  void (*free_fn)(void *ctx, void *ptr);                   /**< Releases ptr, which may be NULL */
+  void *ctx;                                               /**< Passed through to every function */
+} prom_allocator_t;
 
 /**
- * @brief Redefine this macro if you wish to override it. The default value is realloc.
+ * @brief Replaces the allocator behind prom_malloc, prom_calloc, prom_realloc, prom_strdup and prom_free.
+ *
+ * The allocator is copied. This function MUST be called before any other function in this library, since memory
+ * obtained from one allocator cannot be released through another. Pass NULL to restore the libc allocator.
+ *
+ * @param allocator The allocator to use for all memory the library does not allocate on behalf of a registry
  */
-#define prom_realloc realloc
+void prom_allocator_set_default(const prom_allocator_t *allocator);
 
 /**
- * @brief Redefine this macro if you wish to override it. The default value is strdup.
+ * @brief Returns the allocator behind prom_malloc and friends
  */
-#define prom_strdup strdup
+const prom_allocator_t *prom_allocator_default(void);
 
 /**
- * @brief Redefine this macro if you wish to override it. The default value is free.
+ * @brief Returns an allocator that carves memory out of large blocks and frees nothing until it is destroyed.
+ *
+ * An arena suits long-lived metric metadata such as label key arrays and samples. Memory handed to free_fn is
+ * not reused, so an arena SHOULD NOT back metrics whose label sets are created and dropped continuously. The returned
+ * allocator is safe to use from multiple threads and its memory is aligned to 8 bytes.
+ *
+ * @param block_size The size of each block requested from the default allocator. 0 selects a default.
+ * @return The arena's allocator, or NULL upon failure
  */
-#define prom_free free
+prom_allocator_t *prom_arena_allocator_new(size_t block_size);
+
+/**
+ * @brief Releases an arena returned by prom_arena_allocator_new and every allocation made from it.
+ *
+ * Everything that allocated from the arena, such as a prom_collector_registry_t configured with
+ * prom_collector_registry_set_allocator, MUST be destroyed first.
+ */
+void prom_arena_allocator_destroy(prom_allocator_t *allocator);
+
+void *prom_allocator_malloc(const prom_allocator_t *allocator, size_t size);
+void *prom_allocator_calloc(const prom_allocator_t *allocator, size_t count, size_t size);
+void *prom_allocator_realloc(const prom_allocator_t *allocator, void *ptr, size_t size);
+char *prom_allocator_strdup(const prom_allocator_t *allocator, const char *str);
+void prom_allocator_free(const prom_allocator_t *allocator, void *ptr);
+
+void *prom_default_malloc(size_t size);
+void *prom_default_calloc(size_t count, size_t size);
+void *prom_default_realloc(void *ptr, size_t size);
+char *prom_default_strdup(const char *str);
+void prom_default_free(void *ptr);
+
+/**
+ * @brief Redefine this macro if you wish to override it. The default value is prom_default_malloc, which dispatches
+ * to the allocator set with prom_allocator_set_default.
+ */
+#define prom_malloc prom_default_malloc
+
+/**
+ * @brief Redefine this macro if you wish to override it. The default value is prom_default_calloc.
+ */
+#define prom_calloc prom_default_calloc
+
+/**
+ * @brief Redefine this macro if you wish to override it. The default value is prom_default_realloc.
+ */
+#define prom_realloc prom_default_realloc
+
+/**
+ * @brief Redefine this macro if you wish to override it. The default value is prom_default_strdup.
+ */
+#define prom_strdup prom_default_strdup
+
+/**
+ * @brief Redefine this macro if you wish to override it. The default value is prom_default_free.
+ */
+#define prom_free prom_default_free
 
 #endif  // PROM_ALLOC_H
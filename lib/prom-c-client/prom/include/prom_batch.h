@@ -0,0 +1,73 @@
+/*
+Copyright 2019-2020 DigitalOcean Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/**
+ * @file prom_batch.h
+ * @brief Apply many metric updates in one call
+ */
+
+#ifndef PROM_BATCH_H
+#define PROM_BATCH_H
+
+#include <stdlib.h>
+
+#include "prom_metric.h"
+
+/**
+ * @brief The operation of a prom_batch_update_t
+ */
+typedef enum prom_batch_op {
+  PROM_BATCH_SET,     /**< Set a gauge to value */
+  PROM_BATCH_ADD,     /**< Add value to a counter or a gauge */
+  PROM_BATCH_SUB,     /**< Subtract value from a gauge */
+  PROM_BATCH_OBSERVE, /**< Observe value in a histogram or a summary */
+} prom_batch_op_t;
+
+/**
+ * @brief One update applied by prom_batch_apply
+ */
+typedef struct prom_batch_update {
+  prom_metric_t *metric;     /**< The counter, gauge, histogram or summary to update */
+  const char **label_values; /**< The label values of the series to update, or NULL if the metric has no labels */
+  prom_batch_op_t op;        /**< What to do with value */
+  double value;              /**< The operand of op */
+} prom_batch_update_t;
+
+/**
+ * @brief Applies count updates in order. Each is equivalent to the matching prom_gauge_set, prom_counter_add,
+ * prom_gauge_add, prom_gauge_sub, prom_histogram_observe or prom_summary_observe call.
+ *
+ * Consecutive updates of the same metric are resolved together: the series that already exist are found without
+ * locking and all missing ones are created under a single acquisition of the metric's lock. Group the updates of a
+ * metric next to each other to get the most out of this.
+ *
+ * An update that fails, e.g. because op does not apply to the type of its metric, does not stop the others.
+ *
+ * @param updates The updates to apply
+ * @param count The number of updates
+ * @return A non-zero integer value if any update failed
+ *
+ * *Example*
+ *
+ *     prom_batch_update_t updates[] = {
+ *         {memory_used, NULL, PROM_BATCH_SET, used},
+ *         {memory_available, NULL, PROM_BATCH_SET, available},
+ *     };
+ *     prom_batch_apply(updates, sizeof(updates) / sizeof(updates[0]));
+ */
+int prom_batch_apply(const prom_batch_update_t *updates, size_t count);
+
+#endif  // PROM_BATCH_H
@@ -22,6 +22,7 @@ limitations under the License.
 #ifndef PROM_REGISTRY_H
 #define PROM_REGISTRY_H
 
+#include "prom_alloc.h"
 #include "prom_collector.h"
 #include "prom_metric.h"
 
@@ -63,6 +64,21 @@ int prom_collector_registry_destroy(prom_collector_registry_t *self);
  */
 int prom_collector_registry_enable_process_metrics(prom_collector_registry_t *self);
 
+/**
+ * @brief Makes allocator the home of long-lived metric metadata for every collector registered with self, now and
+ * later: the label key arrays of metrics and the samples created from now on. Label strings stay with the default
+ * allocator, where equal strings are shared across registries. So do prom_series_evicted_total and
+ * prom_series_overflow_updates_total, which process collectors expose but which outlive any one registry.
+ *
+ * Passing an arena from prom_arena_allocator_new packs this metadata into a few large blocks that are released at
+ * once by prom_arena_allocator_destroy after the registry has been destroyed.
+ *
+ * @param self The target prom_collector_registry_t*
+ * @param allocator The allocator to use, or NULL for the default allocator
+ * @return A non-zero integer value upon failure
+ */
+int prom_collector_registry_set_allocator(prom_collector_registry_t *self, const prom_allocator_t *allocator);
+
 /**
  * @brief Registers a metric with the default collector on PROM_DEFAULT_COLLECTOR_REGISTRY
  *
@@ -96,8 +112,8 @@ int prom_collector_registry_register_metric(prom_metric_t *metric);
 int prom_collector_registry_register_collector(prom_collector_registry_t *self, prom_collector_t *collector);
 
 /**
- * @brief Returns a string in the default metric exposition format. The string MUST be freed to avoid unnecessary heap
- * memory growth.
+ * @brief Returns a string in the default metric exposition format. The string MUST be freed with prom_free to avoid
+ * unnecessary heap memory growth.
  *
  * Reference: https://prometheus.io/docs/instrumenting/exposition_formats/
  *
@@ -55,6 +55,22 @@ typedef prom_metric_t prom_counter_t;
  */
 prom_counter_t *prom_counter_new(const char *name, const char *help, size_t label_key_count, const char **label_keys);
 
+/**
+ * @brief Constructs a prom_counter_t* without labels whose value is computed by fn each time the counter is scraped.
+ *
+ * This exposes a total that is already kept elsewhere, e.g. by the kernel, without mirroring it between scrapes. fn
+ * MUST return values that never decrease, is called from whichever thread renders the registry and MUST be safe to
+ * call from it. The counter only ever exposes what fn returns, so it is not meant to be updated with prom_counter_inc
+ * and friends.
+ *
+ * @param name The name of the metric
+ * @param help The metric description
+ * @param fn The function that computes the value of the counter
+ * @param ctx A pointer passed to fn on every call
+ * @return The constructed prom_counter_t*
+ */
+prom_counter_t *prom_counter_new_func(const char *name, const char *help, prom_metric_value_fn fn, void *ctx);
+
 /**
  * @brief Destroys a prom_counter_t*. You must set self to NULL after destruction. A non-zero integer value will be
  *        returned on failure.
@@ -100,4 +116,26 @@ int prom_counter_inc(prom_counter_t *self, const char **label_values);
  */
 int prom_counter_add(prom_counter_t *self, double r_value, const char **label_values);
 
+/**
+ * @brief Returns the sample of the prom_counter_t for the given label values, creating it if needed. NULL is returned
+ *        on failure.
+ *
+ * The label values are formatted and looked up once. Updating the returned sample with prom_metric_sample_add is then
+ * a single atomic operation, which makes it the cheapest way to update a series on a hot path. The sample remains
+ * valid until the counter is destroyed.
+ *
+ * @param self The target prom_counter_t*
+ * @param label_values The label values associated with the metric sample. The number of labels must match the value
+ *                     passed to label_key_count in the counter's constructor. If no label values are necessary, pass
+ *                     NULL. Otherwise, It may be convenient to pass this value as a literal.
+ * @return The prom_metric_sample_t* for the label values
+ *
+ * *Example*
+ *
+ *     prom_metric_sample_t *bar_bang = prom_counter_labels(foo_counter, (const char**) { "bar", "bang" });
+ *     ...
+ *     prom_metric_sample_add(bar_bang, 1);
+ */
+prom_metric_sample_t *prom_counter_labels(prom_counter_t *self, const char **label_values);
+
 #endif  // PROM_COUNTER_H
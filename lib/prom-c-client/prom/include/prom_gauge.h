@@ -53,6 +53,25 @@ typedef prom_metric_t prom_gauge_t;
  */
 prom_gauge_t *prom_gauge_new(const char *name, const char *help, size_t label_key_count, const char **label_keys);
 
+/**
+ * @brief Constructs a prom_gauge_t* without labels whose value is computed by fn each time the gauge is scraped.
+ *
+ * This suits values that are cheap to read on demand, e.g. from a file under /proc or /sys, since nothing is read
+ * between scrapes. fn is called from whichever thread renders the registry and MUST be safe to call from it. The gauge
+ * only ever exposes what fn returns, so it is not meant to be updated with prom_gauge_set and friends.
+ *
+ * @param name The name of the metric
+ * @param help The metric description
+ * @param fn The function that computes the value of the gauge
+ * @param ctx A pointer passed to fn on every call
+ * @return The constructed prom_gauge_t*
+ *
+ *     static int read_load(void *ctx, double *value) { ... }
+ *
+ *     prom_gauge_new_func("load1", "load1 is read when it is scraped", read_load, NULL);
+ */
+prom_gauge_t *prom_gauge_new_func(const char *name, const char *help, prom_metric_value_fn fn, void *ctx);
+
 /**
  * @brief Destroys a prom_gauge_t*. You must set self to NULL after destruction. A non-zero integer value will be
  *        returned on failure.
@@ -152,4 +171,26 @@ int prom_gauge_sub(prom_gauge_t *self, double r_value, const char **label_values
  */
 int prom_gauge_set(prom_gauge_t *self, double r_value, const char **label_values);
 
+/**
+ * @brief Returns the sample of the prom_gauge_t for the given label values, creating it if needed. NULL is returned
+ *        on failure.
+ *
+ * The label values are formatted and looked up once. Updating the returned sample with prom_metric_sample_add,
+ * prom_metric_sample_sub or prom_metric_sample_set is then a single atomic operation, which makes it the cheapest way
+ * to update a series on a hot path. The sample remains valid until the gauge is destroyed.
+ *
+ * @param self The target prom_gauge_t*
+ * @param label_values The label values associated with the metric sample. The number of labels must match the value
+ *                     passed to label_key_count in the gauge's constructor. If no label values are necessary, pass
+ *                     NULL. Otherwise, It may be convenient to pass this value as a literal.
+ * @return The prom_metric_sample_t* for the label values
+ *
+ * *Example*
+ *
+ *     prom_metric_sample_t *bar_bang = prom_gauge_labels(foo_gauge, (const char**) { "bar", "bang" });
+ *     ...
+ *     prom_metric_sample_set(bar_bang, 22);
+ */
+prom_metric_sample_t *prom_gauge_labels(prom_gauge_t *self, const char **label_values);
+
 #endif  // PROM_GAUGE_H
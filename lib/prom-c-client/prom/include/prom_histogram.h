@@ -35,6 +35,21 @@ limitations under the License.
  */
 typedef prom_metric_t prom_histogram_t;
 
+/**
+ * @brief The finest schema of a sparse histogram, which splits every power of two into 256 buckets
+ */
+#define PROM_HISTOGRAM_SPARSE_SCHEMA_MAX 8
+
+/**
+ * @brief The coarsest schema of a sparse histogram, which merges 16 powers of two into one bucket
+ */
+#define PROM_HISTOGRAM_SPARSE_SCHEMA_MIN -4
+
+/**
+ * @brief The most le values, +Inf aside, that a sparse histogram exposes in the text format
+ */
+#define PROM_HISTOGRAM_SPARSE_TEXT_BUCKETS_MAX 32
+
 /**
  *@brief Construct a prom_histogram_t*
  * @param name The name of the metric
@@ -60,6 +75,47 @@ typedef prom_metric_t prom_histogram_t;
 prom_histogram_t *prom_histogram_new(const char *name, const char *help, prom_histogram_buckets_t *buckets,
                                      size_t label_key_count, const char **label_keys);
 
+/**
+ * @brief Construct a sparse prom_histogram_t*, whose buckets grow exponentially without bound and only take memory once
+ *        an observation falls in them.
+ *
+ * Each power of two is split into 2^schema buckets of equal ratio, so with schema 3 a bucket is about 9% wider than the
+ * one below it. Observations no further from zero than zero_threshold are counted in a single zero bucket, and
+ * negative observations get buckets of their own mirroring the positive ones.
+ *
+ * These buckets are how the series are stored. The only exposition format is text, which has no sparse buckets, so
+ * every series of the metric is exposed as a classic histogram with the same fixed le values: the bounds of the
+ * buckets from text_low to text_high at the finest schema, at most schema, that covers the range in
+ * PROM_HISTOGRAM_SPARSE_TEXT_BUCKETS_MAX buckets or fewer. Each le value is a bucket bound, so its count is exact.
+ * Observations below text_low, negative ones and the zero bucket included, count from the lowest le value on, and
+ * those above text_high only count towards le="+Inf", as do observations that are not finite.
+ *
+ * Series of a sparse histogram are never striped, see prom_metric_set_sample_cells.
+ *
+ * @param name The name of the metric
+ * @param help The metric description
+ * @param schema The resolution, from PROM_HISTOGRAM_SPARSE_SCHEMA_MIN to PROM_HISTOGRAM_SPARSE_SCHEMA_MAX
+ * @param zero_threshold The upper bound of the zero bucket. Pass 0 for a zero bucket of exact zeroes only.
+ * @param text_low The lowest value the text format tells apart. It MUST be positive and at least zero_threshold
+ * @param text_high The highest value the text format tells apart. It MUST be finite and at least text_low
+ * @param label_key_count is the number of labels associated with the given metric. Pass 0 if the metric does not
+ *                        require labels.
+ * @param label_keys A collection of label keys. The number of keys MUST match the value passed as label_key_count. If
+ *                   no labels are required, pass NULL. Otherwise, it may be convenient to pass this value as a
+ *                   literal.
+ * @return The constructed prom_histogram_t*, or NULL if the schema is out of range, the threshold is negative or the
+ *         range is invalid or too wide for PROM_HISTOGRAM_SPARSE_TEXT_BUCKETS_MAX buckets even at the coarsest schema
+ *
+ * *Example*
+ *
+ *     // Request latencies in seconds, with buckets about 9% apart, exposed from 1ms to 10s
+ *     prom_histogram_new_sparse("foo_seconds", "foo is a sparse histogram", 3, 0.0, 0.001, 10.0, 1,
+ *                               (const char*[]) { "path" });
+ */
+prom_histogram_t *prom_histogram_new_sparse(const char *name, const char *help, int schema, double zero_threshold,
+                                            double text_low, double text_high, size_t label_key_count,
+                                            const char **label_keys);
+
 /**
  * @brief Destroy a prom_histogram_t*. self MUSTS be set to NULL after destruction. Returns a non-zero integer value
  *        upon failure.
@@ -78,4 +134,27 @@ int prom_histogram_destroy(prom_histogram_t *self);
  */
 int prom_histogram_observe(prom_histogram_t *self, double value, const char **label_values);
 
+/**
+ * @brief Returns the sample of the prom_histogram_t for the given label values, creating it if needed. NULL is returned
+ *        on failure.
+ *
+ * The label values are formatted and looked up once. Observing through the returned sample with
+ * prom_metric_sample_histogram_observe then skips that work entirely, which makes it the cheapest way to update a
+ * series on a hot path. The sample remains valid until the histogram is destroyed.
+ *
+ * @param self The target prom_histogram_t*
+ * @param label_values The label values associated with the metric sample. The number of labels must match the value
+ *                     passed to label_key_count in the histogram's constructor. If no label values are necessary, pass
+ *                     NULL. Otherwise, It may be convenient to pass this value as a literal.
+ * @return The prom_metric_sample_histogram_t* for the label values
+ *
+ * *Example*
+ *
+ *     prom_metric_sample_histogram_t *bar_bang =
+ *         prom_histogram_labels(foo_histogram, (const char**) { "bar", "bang" });
+ *     ...
+ *     prom_metric_sample_histogram_observe(bar_bang, 0.25);
+ */
+prom_metric_sample_histogram_t *prom_histogram_labels(prom_histogram_t *self, const char **label_values);
+
 #endif  // PROM_HISTOGRAM_INCLUDED
@@ -22,8 +22,11 @@ limitations under the License.
 #ifndef PROM_METRIC_H
 #define PROM_METRIC_H
 
+#include <stddef.h>
+
 #include "prom_metric_sample.h"
 #include "prom_metric_sample_histogram.h"
+#include "prom_metric_sample_summary.h"
 
 struct prom_metric;
 /**
@@ -33,6 +36,15 @@ struct prom_metric;
  */
 typedef struct prom_metric prom_metric_t;
 
+/**
+ * @brief Computes the value of a callback metric when the metric is scraped.
+ * @param ctx The ctx the metric was constructed with
+ * @param value Where to store the value
+ * @return A non-zero integer value if there is no value to expose for this scrape, in which case the metric is exposed
+ *         without a sample
+ */
+typedef int (*prom_metric_value_fn)(void *ctx, double *value);
+
 /**
  * @brief Returns a prom_metric_sample_t*. The order of label_values is significant.
  *
@@ -64,4 +76,89 @@ prom_metric_sample_t *prom_metric_sample_from_labels(prom_metric_t *self, const
 prom_metric_sample_histogram_t *prom_metric_sample_histogram_from_labels(prom_metric_t *self,
                                                                          const char **label_values);
 
+/**
+ * @brief Returns a prom_metric_sample_summary_t*. The order of label_values is significant.
+ *
+ * Same as prom_metric_sample_histogram_from_labels for summaries.
+ *
+ * @param self The target prom_summary_t*
+ * @param label_values The label values associated with the metric sample being updated. The number of labels must
+ *                     match the value passed to label_key_count in the summary's constructor. If no label values are
+ *                     necessary, pass NULL. Otherwise, It may be convenient to pass this value as a literal.
+ * @return prom_metric_sample_summary_t*
+ */
+prom_metric_sample_summary_t *prom_metric_sample_summary_from_labels(prom_metric_t *self, const char **label_values);
+
+/**
+ * @brief Spreads the samples of a metric over shard_count independently locked shards.
+ *
+ * By default every new label set of a metric is inserted under a single lock. Metrics that constantly create and drop
+ * series from many threads may opt into sharding so that inserts for different label sets rarely contend. shard_count
+ * is rounded up to a power of two. Samples of a sharded metric are exported grouped by shard rather than strictly in
+ * the order they were created.
+ *
+ * This function MUST be called right after the metric is constructed, before any sample exists and before the metric
+ * is shared with other threads.
+ *
+ * @param self The target prom_metric_t*
+ * @param shard_count The number of shards
+ * @return A non-zero integer value upon failure
+ */
+int prom_metric_set_sample_shards(prom_metric_t *self, size_t shard_count);
+
+/**
+ * @brief Stripes every sample of a counter or histogram over cell_count cells that are summed when the metric is
+ * scraped.
+ *
+ * By default all threads updating a sample add to the same value, and under heavy contention the cache line holding it
+ * bounces between CPUs. A striped sample gives each thread one of cell_count cache-line-sized cells to add to instead,
+ * so updates from different threads rarely touch the same line. Scrapes pay for this by summing the cells, and each
+ * sample grows by 64 bytes per cell, so striping suits a few hot series rather than metrics with many label sets.
+ * cell_count is rounded up to a power of two and SHOULD be at least the number of updating threads. Gauges cannot be
+ * striped since their values may be set, nor can summaries, and the series of sparse histograms are never striped.
+ *
+ * This function MUST be called right after the metric is constructed, before any sample exists and before the metric
+ * is shared with other threads.
+ *
+ * @param self The target prom_metric_t*
+ * @param cell_count The number of cells per sample. 0 or 1 turns striping off
+ * @return A non-zero integer value upon failure
+ */
+int prom_metric_set_sample_cells(prom_metric_t *self, size_t cell_count);
+
+/**
+ * @brief Evicts the series of a metric that have not been updated for ttl seconds.
+ *
+ * Series whose labels stop being used, e.g. those of a container, network interface or process that went away, stay
+ * in memory and are exposed on every scrape by default. With a TTL, a background thread removes them once they have
+ * been idle for ttl seconds, give or take a quarter of ttl, without blocking updates of other series. An update of an
+ * evicted series simply creates it again. Evictions are counted in prom_series_evicted_total, which is exposed along
+ * with the process metrics.
+ *
+ * Series whose samples were handed out by prom_metric_sample_from_labels, prom_metric_sample_histogram_from_labels,
+ * prom_metric_sample_summary_from_labels or the *_labels functions of counters, gauges, histograms and summaries are
+ * never evicted, since the caller may keep using them.
+ * The sample of a metric without labels is never evicted either.
+ *
+ * @param self The target prom_metric_t*
+ * @param ttl The TTL in seconds. 0 turns eviction off
+ * @return A non-zero integer value upon failure
+ */
+int prom_metric_set_series_ttl(prom_metric_t *self, double ttl);
+
+/**
+ * @brief Caps the number of series of a metric.
+ *
+ * A label with unbounded values, e.g. a raw request path, would otherwise create a series for every value it ever
+ * takes. Once the metric holds max_series series, updates for new label sets all go to a single series labeled
+ * {overflow="true"} instead. prom_series_overflow_updates_total, which is exposed along with the process metrics,
+ * counts each such update, so a label set that keeps coming back is counted every time rather than once. Series that
+ * already exist are not affected, and evicting stale series with a TTL makes room for new ones again.
+ *
+ * @param self The target prom_metric_t*
+ * @param max_series The most series the metric may have. 0 removes the limit
+ * @return A non-zero integer value upon failure
+ */
+int prom_metric_set_max_series(prom_metric_t *self, size_t max_series);
+
 #endif  // PROM_METRIC_H
@@ -0,0 +1,120 @@
+/*
+Copyright 2019-2020 DigitalOcean Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/**
+ * @file prom_summary.h
+ * @brief https://prometheus.io/docs/concepts/metric_types/#summary
+ */
+
+#ifndef PROM_SUMMARY_INCLUDED
+#define PROM_SUMMARY_INCLUDED
+
+#include <stdlib.h>
+
+#include "prom_metric.h"
+#include "prom_metric_sample_summary.h"
+
+/**
+ * @brief A prometheus summary.
+ *
+ * A summary exposes quantiles of the values observed over a sliding time window, along with the sum and the count of
+ * every value observed. Each series estimates its quantiles with a streaming sketch, so its memory is bounded no matter
+ * how many values are observed, and a quantile q is off by at most min(q, 1 - q) / 10 in rank, e.g. 0.05 for the
+ * median and 0.0001 for the 99.9th percentile.
+ *
+ * References
+ * * See https://prometheus.io/docs/concepts/metric_types/#summary
+ * * Cormode, Korn, Muthukrishnan and Srivastava, Effective Computation of Biased Quantiles over Data Streams
+ */
+typedef prom_metric_t prom_summary_t;
+
+/**
+ * @brief Construct a prom_summary_t*
+ *
+ * The window defaults to the last 10 minutes in 5 age buckets. See prom_summary_set_max_age.
+ *
+ * @param name The name of the metric
+ * @param help The metric description
+ * @param quantile_count The number of quantiles. Pass 0 for the 0.5, 0.99 and 0.999 quantiles.
+ * @param quantiles The quantiles to expose, each strictly between 0 and 1. The array is copied. Pass NULL if
+ *                  quantile_count is 0.
+ * @param label_key_count is the number of labels associated with the given metric. Pass 0 if the metric does not
+ *                        require labels.
+ * @param label_keys A collection of label keys. The number of keys MUST match the value passed as label_key_count. If
+ *                   no labels are required, pass NULL. Otherwise, it may be convenient to pass this value as a
+ *                   literal.
+ * @return The constructed prom_summary_t*, or NULL if a quantile is out of range
+ *
+ * *Example*
+ *
+ *     // The median and the 99th percentile of request latencies
+ *     prom_summary_new("foo_seconds", "foo is a summary", 2, (const double[]) { 0.5, 0.99 }, 0, NULL);
+ */
+prom_summary_t *prom_summary_new(const char *name, const char *help, size_t quantile_count, const double *quantiles,
+                                 size_t label_key_count, const char **label_keys);
+
+/**
+ * @brief Destroy a prom_summary_t*. self MUST be set to NULL after destruction. Returns a non-zero integer value upon
+ *        failure.
+ * @return Non-zero value upon failure.
+ */
+int prom_summary_destroy(prom_summary_t *self);
+
+/**
+ * @brief Sets the sliding window the quantiles of the prom_summary_t are computed over.
+ *
+ * Observations are kept in age_bucket_count overlapping sketches that are started max_age / age_bucket_count seconds
+ * apart, and the quantiles come from the oldest one. They thus cover between max_age - max_age / age_bucket_count and
+ * max_age seconds. More age buckets make the window slide more smoothly, at the expense of memory and of observations,
+ * which go into every age bucket.
+ *
+ * This function MUST be called right after the summary is constructed, before any sample exists and before the summary
+ * is shared with other threads.
+ *
+ * @param self The target prom_summary_t*
+ * @param max_age The length of the window in seconds
+ * @param age_bucket_count The number of age buckets, at least 1
+ * @return A non-zero integer value upon failure
+ */
+int prom_summary_set_max_age(prom_summary_t *self, double max_age, size_t age_bucket_count);
+
+/**
+ * @brief Observe the prom_summary_t given the value and labels
+ * @param self The target prom_summary_t*
+ * @param value The value to observe
+ * @param label_values The label values associated with the metric sample. The number of labels must match the value
+ *                     passed to label_key_count in the summary's constructor. If no label values are necessary, pass
+ *                     NULL. Otherwise, it may be convenient to pass this value as a literal.
+ * @return Non-zero value upon failure
+ */
+int prom_summary_observe(prom_summary_t *self, double value, const char **label_values);
+
+/**
+ * @brief Returns the sample of the prom_summary_t for the given label values, creating it if needed. NULL is returned
+ *        on failure.
+ *
+ * Observing through the returned sample with prom_metric_sample_summary_observe skips looking the series up. The sample
+ * remains valid until the summary is destroyed.
+ *
+ * @param self The target prom_summary_t*
+ * @param label_values The label values associated with the metric sample. The number of labels must match the value
+ *                     passed to label_key_count in the summary's constructor. If no label values are necessary, pass
+ *                     NULL. Otherwise, It may be convenient to pass this value as a literal.
+ * @return The prom_metric_sample_summary_t* for the label values
+ */
+prom_metric_sample_summary_t *prom_summary_labels(prom_summary_t *self, const char **label_values);
+
+#endif  // PROM_SUMMARY_INCLUDED
@@ -0,0 +1,83 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+// Public
+#include "prom_alloc.h"
+
+static void *prom_libc_malloc(void *ctx, size_t size) { return malloc(size); }
+
+static void *prom_libc_calloc(void *ctx, size_t count, size_t size) { return calloc(count, size); }
+
+static void *prom_libc_realloc(void *ctx, void *ptr, size_t size) { return realloc(ptr, size); }
+
+static void prom_libc_free(void *ctx, void *ptr) { free(ptr); }
+
+static const prom_allocator_t prom_allocator_libc = {.malloc_fn = prom_libc_malloc,
+                                                     .calloc_fn = prom_libc_calloc,
+                                                     .realloc_fn = prom_libc_realloc,
+                                                     .free_fn = prom_libc_free,
+                                                     .ctx = NULL};
+
+static prom_allocator_t prom_allocator_current = {.malloc_fn = prom_libc_malloc,
+                                                  .calloc_fn = prom_libc_calloc,
+                                                  .realloc_fn = prom_libc_realloc,
+                                                  .free_fn = prom_libc_free,
+                                                  .ctx = NULL};
+
+void prom_allocator_set_default(const prom_allocator_t *allocator) {
+  prom_allocator_current = allocator != NULL ? *allocator : prom_allocator_libc;
+}
+
+const prom_allocator_t *prom_allocator_default(void) { return &prom_allocator_current; }
+
+void *prom_allocator_malloc(const prom_allocator_t *allocator, size_t size) {
+  return (*allocator->malloc_fn)(allocator->ctx, size);
+}
+
+void *prom_allocator_calloc(const prom_allocator_t *allocator, size_t count, size_t size) {
+  return (*allocator->calloc_fn)(allocator->ctx, count, size);
+}
+
+void *prom_allocator_realloc(const prom_allocator_t *allocator, void *ptr, size_t size) {
+  return (*allocator->realloc_fn)(allocator->ctx, ptr, size);
+}
+
+char *prom_allocator_strdup(const prom_allocator_t *allocator, const char *str) {
+  size_t size = strlen(str) + 1;
+  char *copy = (char *)(*allocator->malloc_fn)(allocator->ctx, size);
+  if (copy == NULL) return NULL;
+  memcpy(copy, str, size);
+  return copy;
+}
+
+void prom_allocator_free(const prom_allocator_t *allocator, void *ptr) { (*allocator->free_fn)(allocator->ctx, ptr); }
+
+void *prom_default_malloc(size_t size) { return prom_allocator_malloc(&prom_allocator_current, size); }
+
+void *prom_default_calloc(size_t count, size_t size) {
+  return prom_allocator_calloc(&prom_allocator_current, count, size);
+}
+
+void *prom_default_realloc(void *ptr, size_t size) {
+  return prom_allocator_realloc(&prom_allocator_current, ptr, size);
+}
+
+char *prom_default_strdup(const char *str) { return prom_allocator_strdup(&prom_allocator_current, str); }
+
+void prom_default_free(void *ptr) { prom_allocator_free(&prom_allocator_current, ptr); }
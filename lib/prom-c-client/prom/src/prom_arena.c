@@ -0,0 +1,119 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+// Public
+#include "prom_alloc.h"
+
+// Private
+#include "prom_arena_t.h"
+#include "prom_assert.h"
+
+// The block size used when none is given
+#define PROM_ARENA_DEFAULT_BLOCK_SIZE 65536
+
+// Every allocation is preceded by its size so that it can be resized
+#define PROM_ARENA_HEADER_SIZE sizeof(size_t)
+
+#define PROM_ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+static void *prom_arena_malloc(void *ctx, size_t size) {
+  prom_arena_t *self = (prom_arena_t *)ctx;
+  size_t needed = PROM_ARENA_ALIGN(PROM_ARENA_HEADER_SIZE + size);
+
+  pthread_mutex_lock(&self->lock);
+  prom_arena_block_t *block = self->blocks;
+  if (block == NULL || block->size - block->used < needed) {
+    // Oversized allocations get a block of their own, which goes behind the current one so that it keeps filling
+    size_t block_size = needed > self->block_size ? needed : self->block_size;
+    prom_arena_block_t *new_block = (prom_arena_block_t *)prom_malloc(sizeof(prom_arena_block_t) + block_size);
+    if (new_block == NULL) {
+      pthread_mutex_unlock(&self->lock);
+      return NULL;
+    }
+    new_block->size = block_size;
+    new_block->used = 0;
+    if (block != NULL && block_size > self->block_size) {
+      new_block->next = block->next;
+      block->next = new_block;
+    } else {
+      new_block->next = block;
+      self->blocks = new_block;
+    }
+    block = new_block;
+  }
+  char *p = block->data + block->used;
+  block->used += needed;
+  pthread_mutex_unlock(&self->lock);
+
+  memcpy(p, &size, sizeof(size));
+  return p + PROM_ARENA_HEADER_SIZE;
+}
+
+static void *prom_arena_calloc(void *ctx, size_t count, size_t size) {
+  if (size != 0 && count > SIZE_MAX / size) return NULL;
+  void *p = prom_arena_malloc(ctx, count * size);
+  if (p != NULL) memset(p, 0, count * size);
+  return p;
+}
+
+static void *prom_arena_realloc(void *ctx, void *ptr, size_t size) {
+  if (ptr == NULL) return prom_arena_malloc(ctx, size);
+  size_t old_size;
+  memcpy(&old_size, (char *)ptr - PROM_ARENA_HEADER_SIZE, sizeof(old_size));
+  if (size <= old_size) return ptr;
+  void *p = prom_arena_malloc(ctx, size);
+  if (p != NULL) memcpy(p, ptr, old_size);
+  return p;
+}
+
+static void prom_arena_free(void *ctx, void *ptr) {}
+
+prom_allocator_t *prom_arena_allocator_new(size_t block_size) {
+  prom_arena_t *self = (prom_arena_t *)prom_malloc(sizeof(prom_arena_t));
+  if (self == NULL) return NULL;
+  self->allocator.malloc_fn = prom_arena_malloc;
+  self->allocator.calloc_fn = prom_arena_calloc;
+  self->allocator.realloc_fn = prom_arena_realloc;
+  self->allocator.free_fn = prom_arena_free;
+  self->allocator.ctx = self;
+  self->block_size = block_size != 0 ? block_size : PROM_ARENA_DEFAULT_BLOCK_SIZE;
+  self->blocks = NULL;
+  if (pthread_mutex_init(&self->lock, NULL)) {
+    prom_free(self);
+    return NULL;
+  }
+  return &self->allocator;
+}
+
+void prom_arena_allocator_destroy(prom_allocator_t *allocator) {
+  if (allocator == NULL) return;
+  prom_arena_t *self = (prom_arena_t *)allocator->ctx;
+  PROM_ASSERT(&self->allocator == allocator);
+
+  prom_arena_block_t *block = self->blocks;
+  while (block != NULL) {
+    prom_arena_block_t *next = block->next;
+    prom_free(block);
+    block = next;
+  }
+  self->blocks = NULL;
+  pthread_mutex_destroy(&self->lock);
+  prom_free(self);
+}
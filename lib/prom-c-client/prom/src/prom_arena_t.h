@@ -0,0 +1,47 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_ARENA_T_H
+#define PROM_ARENA_T_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Public
+#include "prom_alloc.h"
+
+/**
+ * @brief API PRIVATE A block of memory handed out front to back by an arena
+ */
+typedef struct prom_arena_block {
+  struct prom_arena_block *next; /**< the previously filled block */
+  size_t size;                   /**< the number of bytes in data */
+  size_t used;                   /**< the number of bytes of data handed out */
+  _Alignas(16) char data[];      /**< the memory of the block */
+} prom_arena_block_t;
+
+/**
+ * @brief API PRIVATE A bump allocator. The allocator MUST remain the first member so that the prom_allocator_t* handed
+ * to users can be converted back.
+ */
+typedef struct prom_arena {
+  prom_allocator_t allocator;  /**< the vtable handed to users, with ctx pointing back at the arena */
+  pthread_mutex_t lock;        /**< guards blocks */
+  size_t block_size;           /**< the size of each regular block */
+  prom_arena_block_t *blocks;  /**< the block currently being filled, followed by the full ones */
+} prom_arena_t;
+
+#endif  // PROM_ARENA_T_H
@@ -0,0 +1,49 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Public
+#include "prom_batch.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_metric_i.h"
+
+int prom_batch_apply(const prom_batch_update_t *updates, size_t count) {
+  PROM_ASSERT(updates != NULL || count == 0);
+  if (updates == NULL) return count != 0;
+
+  int r = 0;
+  int ret = 0;
+
+  size_t i = 0;
+  while (i < count) {
+    prom_metric_t *metric = updates[i].metric;
+    if (metric == NULL) {
+      ret = 1;
+      i++;
+      continue;
+    }
+
+    // Hand the run of updates to the same metric over in one go
+    size_t n = 1;
+    while (i + n < count && updates[i + n].metric == metric) n++;
+
+    r = prom_metric_update(metric, n, &updates[i]);
+    if (r) ret = r;
+    i += n;
+  }
+  return ret;
+}
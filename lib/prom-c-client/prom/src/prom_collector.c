@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -24,6 +25,7 @@
 
 // Private
 #include "prom_assert.h"
+#include "prom_collector_i.h"
 #include "prom_collector_t.h"
 #include "prom_log.h"
 #include "prom_map_i.h"
@@ -35,6 +37,8 @@
 #include "prom_process_stat_i.h"
 #include "prom_process_stat_t.h"
 #include "prom_string_builder_i.h"
+#include "prom_sweeper_i.h"
+#include "prom_sweeper_t.h"
 
 prom_map_t *prom_collector_default_collect(prom_collector_t *self) { return self->metrics; }
 
@@ -60,6 +64,7 @@ prom_collector_t *prom_collector_new(const char *name) {
   }
   self->proc_limits_file_path = NULL;
   self->proc_stat_file_path = NULL;
+  self->allocator = prom_allocator_default();
   return self;
 }
 
@@ -113,14 +118,50 @@ int prom_collector_add_metric(prom_collector_t *self, prom_metric_t *metric) {
     PROM_LOG("metric already found in collector");
     return 1;
   }
+  int r = prom_metric_set_allocator(metric, self->allocator);
+  if (r) return r;
   return prom_map_set(self->metrics, metric->name, metric);
 }
 
+/**
+ * @brief API PRIVATE Returns whether metric is prom_series_evicted_total or prom_series_overflow_updates_total. Those
+ * are shared by every process collector and the library itself, so no collector owns them: they are neither moved to
+ * a collector's allocator nor freed with it.
+ */
+static bool prom_collector_metric_is_shared(void *metric) {
+  return metric == prom_series_evicted_total || metric == prom_series_overflow_updates_total;
+}
+
+int prom_collector_set_allocator(prom_collector_t *self, const prom_allocator_t *allocator) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 1;
+  int r = 0;
+  self->allocator = allocator;
+
+  prom_map_cursor_t cursor;
+  void *metric = NULL;
+  prom_map_cursor_begin(self->metrics, &cursor);
+  while (r == 0 && prom_map_cursor_next(&cursor, NULL, &metric)) {
+    if (prom_collector_metric_is_shared(metric)) continue;
+    r = prom_metric_set_allocator((prom_metric_t *)metric, allocator);
+  }
+  prom_map_cursor_end(&cursor);
+  return r;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Process Collector
 
 prom_map_t *prom_collector_process_collect(prom_collector_t *self);
 
+/**
+ * @brief API PRIVATE Frees the metrics of a process collector, except for the shared ones
+ */
+static void prom_collector_process_free_metric(void *metric) {
+  if (prom_collector_metric_is_shared(metric)) return;
+  prom_metric_free_generic(metric);
+}
+
 prom_collector_t *prom_collector_process_new(const char *limits_path, const char *stat_path) {
   prom_collector_t *self = prom_collector_new("process");
   PROM_ASSERT(self != NULL);
@@ -128,6 +169,9 @@ prom_collector_t *prom_collector_process_new(const char *limits_path, const char
 
   int r = 0;
 
+  r = prom_map_set_free_value_fn(self->metrics, &prom_collector_process_free_metric);
+  if (r) return NULL;
+
   self->proc_limits_file_path = limits_path;
   self->proc_stat_file_path = stat_path;
   self->collect_fn = &prom_collector_process_collect;
@@ -162,6 +206,19 @@ prom_collector_t *prom_collector_process_new(const char *limits_path, const char
   r = prom_collector_add_metric(self, prom_process_open_fds);
   if (r) return NULL;
 
+  // Added directly, since the allocator of a collector must not be imposed on a metric it does not own
+  r = prom_sweeper_init();
+  if (r) return NULL;
+
+  r = prom_map_set(self->metrics, prom_series_evicted_total->name, prom_series_evicted_total);
+  if (r) return NULL;
+
+  r = prom_metric_limit_init();
+  if (r) return NULL;
+
+  r = prom_map_set(self->metrics, prom_series_overflow_updates_total->name, prom_series_overflow_updates_total);
+  if (r) return NULL;
+
   return self;
 }
 
@@ -0,0 +1,31 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_COLLECTOR_I_INCLUDED
+#define PROM_COLLECTOR_I_INCLUDED
+
+// Public
+#include "prom_alloc.h"
+
+// Private
+#include "prom_collector_t.h"
+
+/**
+ * @brief API PRIVATE Hands allocator to every metric of the collector, including metrics added later
+ */
+int prom_collector_set_allocator(prom_collector_t *self, const prom_allocator_t *allocator);
+
+#endif  // PROM_COLLECTOR_I_INCLUDED
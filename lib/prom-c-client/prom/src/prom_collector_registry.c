@@ -25,6 +25,7 @@
 
 // Private
 #include "prom_assert.h"
+#include "prom_collector_i.h"
 #include "prom_collector_registry_t.h"
 #include "prom_collector_t.h"
 #include "prom_errors.h"
@@ -44,6 +45,7 @@ prom_collector_registry_t *prom_collector_registry_new(const char *name) {
   prom_collector_registry_t *self = (prom_collector_registry_t *)prom_malloc(sizeof(prom_collector_registry_t));
 
   self->disable_process_metrics = false;
+  self->allocator = prom_allocator_default();
 
   self->name = prom_strdup(name);
   self->collectors = prom_map_new();
@@ -130,6 +132,35 @@ int prom_collector_registry_destroy(prom_collector_registry_t *self) {
   return ret;
 }
 
+int prom_collector_registry_set_allocator(prom_collector_registry_t *self, const prom_allocator_t *allocator) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 1;
+  if (allocator == NULL) allocator = prom_allocator_default();
+
+  int r = 0;
+  r = pthread_rwlock_wrlock(self->lock);
+  if (r) {
+    PROM_LOG(PROM_PTHREAD_RWLOCK_LOCK_ERROR);
+    return r;
+  }
+  self->allocator = allocator;
+
+  prom_map_cursor_t cursor;
+  void *collector = NULL;
+  prom_map_cursor_begin(self->collectors, &cursor);
+  while (r == 0 && prom_map_cursor_next(&cursor, NULL, &collector)) {
+    r = prom_collector_set_allocator((prom_collector_t *)collector, allocator);
+  }
+  prom_map_cursor_end(&cursor);
+
+  int rr = pthread_rwlock_unlock(self->lock);
+  if (rr) {
+    PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);
+    return rr;
+  }
+  return r;
+}
+
 int prom_collector_registry_register_metric(prom_metric_t *metric) {
   PROM_ASSERT(metric != NULL);
 
@@ -172,7 +203,8 @@ int prom_collector_registry_register_collector(prom_collector_registry_t *self,
       return 1;
     }
   }
-  r = prom_map_set(self->collectors, collector->name, collector);
+  r = prom_collector_set_allocator(collector, self->allocator);
+  if (r == 0) r = prom_map_set(self->collectors, collector->name, collector);
   if (r) {
     int rr = pthread_rwlock_unlock(self->lock);
     if (rr) {
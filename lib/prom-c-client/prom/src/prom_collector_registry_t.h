@@ -21,6 +21,7 @@
 #include <stdbool.h>
 
 // Public
+#include "prom_alloc.h"
 #include "prom_collector_registry.h"
 
 // Private
@@ -35,6 +36,7 @@ struct prom_collector_registry {
   prom_string_builder_t *string_builder;     /**< Enables string building */
   prom_metric_formatter_t *metric_formatter; /**< metric formatter for metric exposition on bridge call */
   pthread_rwlock_t *lock;                    /**< mutex for safety against concurrent registration */
+  const prom_allocator_t *allocator;         /**< allocator handed to the metrics of registered collectors */
 };
 
 #endif  // PROM_REGISTRY_T_H
@@ -17,6 +17,7 @@
 #ifndef PROM_COLLECTOR_T_H
 #define PROM_COLLECTOR_T_H
 
+#include "prom_alloc.h"
 #include "prom_collector.h"
 #include "prom_map_t.h"
 #include "prom_string_builder_t.h"
@@ -28,6 +29,7 @@ struct prom_collector {
   prom_string_builder_t *string_builder;
   const char *proc_limits_file_path;
   const char *proc_stat_file_path;
+  const prom_allocator_t *allocator; /**< allocator handed to metrics added to this collector */
 };
 
 #endif  // PROM_COLLECTOR_T_H
@@ -32,6 +32,10 @@ prom_counter_t *prom_counter_new(const char *name, const char *help, size_t labe
   return (prom_counter_t *)prom_metric_new(PROM_COUNTER, name, help, label_key_count, label_keys);
 }
 
+prom_counter_t *prom_counter_new_func(const char *name, const char *help, prom_metric_value_fn fn, void *ctx) {
+  return (prom_counter_t *)prom_metric_new_func(PROM_COUNTER, name, help, fn, ctx);
+}
+
 int prom_counter_destroy(prom_counter_t *self) {
   PROM_ASSERT(self != NULL);
   if (self == NULL) return 0;
@@ -48,9 +52,8 @@ int prom_counter_inc(prom_counter_t *self, const char **label_values) {
     PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
     return 1;
   }
-  prom_metric_sample_t *sample = prom_metric_sample_from_labels(self, label_values);
-  if (sample == NULL) return 1;
-  return prom_metric_sample_add(sample, 1.0);
+  prom_batch_update_t update = {self, label_values, PROM_BATCH_ADD, 1.0};
+  return prom_metric_update(self, 1, &update);
 }
 
 int prom_counter_add(prom_counter_t *self, double r_value, const char **label_values) {
@@ -60,7 +63,16 @@ int prom_counter_add(prom_counter_t *self, double r_value, const char **label_va
     PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
     return 1;
   }
-  prom_metric_sample_t *sample = prom_metric_sample_from_labels(self, label_values);
-  if (sample == NULL) return 1;
-  return prom_metric_sample_add(sample, r_value);
+  prom_batch_update_t update = {self, label_values, PROM_BATCH_ADD, r_value};
+  return prom_metric_update(self, 1, &update);
+}
+
+prom_metric_sample_t *prom_counter_labels(prom_counter_t *self, const char **label_values) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return NULL;
+  if (self->type != PROM_COUNTER) {
+    PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
+    return NULL;
+  }
+  return prom_metric_sample_from_labels(self, label_values);
 }
@@ -0,0 +1,167 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Public
+#include "prom_alloc.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_epoch_i.h"
+#include "prom_epoch_t.h"
+#include "prom_log.h"
+#include "prom_pool_i.h"
+
+// The global epoch. It starts at 1 so that 0 can mark a quiescent record.
+static _Atomic uint64_t prom_epoch_global = 1;
+
+// The list of every record ever allocated. Records are only ever pushed onto the head.
+static _Atomic(prom_epoch_record_t *) prom_epoch_records = NULL;
+
+static __thread prom_epoch_record_t *prom_epoch_local = NULL;
+
+static pthread_once_t prom_epoch_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t prom_epoch_key;
+
+static void prom_epoch_record_release(void *item) {
+  prom_epoch_record_t *record = (prom_epoch_record_t *)item;
+  atomic_store(&record->epoch, 0);
+  record->depth = 0;
+  atomic_store(&record->in_use, false);
+}
+
+static void prom_epoch_key_init(void) { pthread_key_create(&prom_epoch_key, prom_epoch_record_release); }
+
+/**
+ * @brief API PRIVATE Claims a released record or allocates a new one for the calling thread
+ */
+static prom_epoch_record_t *prom_epoch_record_acquire(void) {
+  pthread_once(&prom_epoch_key_once, prom_epoch_key_init);
+
+  prom_epoch_record_t *record = NULL;
+  for (record = atomic_load(&prom_epoch_records); record != NULL; record = record->next) {
+    bool expected = false;
+    if (!atomic_load_explicit(&record->in_use, memory_order_relaxed) &&
+        atomic_compare_exchange_strong(&record->in_use, &expected, true)) {
+      break;
+    }
+  }
+
+  if (record == NULL) {
+    // prom_malloc makes no promise beyond the alignment of a double, so the record is aligned within a larger
+    // allocation. Records are never freed, so the allocation need not be remembered.
+    void *mem = prom_malloc(sizeof(prom_epoch_record_t) + PROM_EPOCH_CACHE_LINE - 1);
+    if (mem == NULL) return NULL;
+    record = (prom_epoch_record_t *)(((uintptr_t)mem + PROM_EPOCH_CACHE_LINE - 1) &
+                                     ~(uintptr_t)(PROM_EPOCH_CACHE_LINE - 1));
+    atomic_init(&record->epoch, 0);
+    atomic_init(&record->in_use, true);
+    record->depth = 0;
+    record->next = atomic_load(&prom_epoch_records);
+    while (!atomic_compare_exchange_weak(&prom_epoch_records, &record->next, record)) {
+    }
+  }
+
+  pthread_setspecific(prom_epoch_key, record);
+  prom_epoch_local = record;
+  return record;
+}
+
+void prom_epoch_enter(void) {
+  prom_epoch_record_t *record = prom_epoch_local;
+  if (record == NULL) {
+    record = prom_epoch_record_acquire();
+    PROM_ASSERT(record != NULL);
+  }
+  if (record->depth++ > 0) return;
+  // Publish the epoch before any shared pointer is read within the section. The exchange is a full barrier.
+  atomic_exchange(&record->epoch, atomic_load_explicit(&prom_epoch_global, memory_order_relaxed));
+}
+
+void prom_epoch_exit(void) {
+  prom_epoch_record_t *record = prom_epoch_local;
+  PROM_ASSERT(record != NULL && record->depth > 0);
+  if (--record->depth > 0) return;
+  atomic_store_explicit(&record->epoch, 0, memory_order_release);
+}
+
+int prom_epoch_retire(prom_epoch_garbage_t *garbage, void *item, prom_epoch_free_fn free_fn) {
+  PROM_ASSERT(garbage != NULL);
+  if (garbage == NULL) return 1;
+
+  prom_epoch_retired_t *retired = (prom_epoch_retired_t *)prom_pool_alloc(sizeof(prom_epoch_retired_t));
+  if (retired == NULL) return 1;
+  retired->item = item;
+  retired->free_fn = free_fn;
+  // Readers that enter after this increment cannot observe the item since it was unlinked beforehand
+  retired->epoch = atomic_fetch_add(&prom_epoch_global, 1) + 1;
+  retired->next = garbage->head;
+  garbage->head = retired;
+  garbage->count++;
+  return 0;
+}
+
+/**
+ * @brief API PRIVATE Returns the oldest epoch observed by an active reader or UINT64_MAX if there is none
+ */
+static uint64_t prom_epoch_min_active(void) {
+  uint64_t min = UINT64_MAX;
+  // Pairs with the seq_cst exchange that publishes the epoch in prom_epoch_enter, so that a reader is either seen here
+  // or sees every prior unlink
+  atomic_thread_fence(memory_order_seq_cst);
+  for (prom_epoch_record_t *record = atomic_load(&prom_epoch_records); record != NULL; record = record->next) {
+    uint64_t epoch = atomic_load(&record->epoch);
+    if (epoch != 0 && epoch < min) min = epoch;
+  }
+  return min;
+}
+
+void prom_epoch_collect(prom_epoch_garbage_t *garbage) {
+  PROM_ASSERT(garbage != NULL);
+  if (garbage == NULL || garbage->head == NULL) return;
+
+  uint64_t min = prom_epoch_min_active();
+  prom_epoch_retired_t **link = &garbage->head;
+  while (*link != NULL) {
+    prom_epoch_retired_t *retired = *link;
+    if (retired->epoch <= min) {
+      *link = retired->next;
+      (*retired->free_fn)(retired->item);
+      prom_pool_free(retired, sizeof(prom_epoch_retired_t));
+      garbage->count--;
+    } else {
+      link = &retired->next;
+    }
+  }
+}
+
+void prom_epoch_purge(prom_epoch_garbage_t *garbage) {
+  PROM_ASSERT(garbage != NULL);
+  if (garbage == NULL) return;
+
+  prom_epoch_retired_t *retired = garbage->head;
+  while (retired != NULL) {
+    prom_epoch_retired_t *next = retired->next;
+    (*retired->free_fn)(retired->item);
+    prom_pool_free(retired, sizeof(prom_epoch_retired_t));
+    retired = next;
+  }
+  garbage->head = NULL;
+  garbage->count = 0;
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Epoch based reclamation for data structures whose readers take no locks.
+//
+// Readers bracket their accesses with prom_epoch_enter and prom_epoch_exit. Writers unlink an item so that new readers
+// cannot reach it and then hand it to prom_epoch_retire. The item is freed by a later prom_epoch_collect once every
+// reader that was active at the time it was retired has left its read-side section. Writers never wait on readers.
+
+#ifndef PROM_EPOCH_I_H
+#define PROM_EPOCH_I_H
+
+// Private
+#include "prom_epoch_t.h"
+
+/**
+ * @brief API PRIVATE Enters a read-side section on the calling thread. Sections may be nested.
+ */
+void prom_epoch_enter(void);
+
+/**
+ * @brief API PRIVATE Leaves the read-side section entered by the matching prom_epoch_enter
+ */
+void prom_epoch_exit(void);
+
+/**
+ * @brief API PRIVATE Schedules item to be freed with free_fn once no reader can reference it. The item MUST already be
+ * unreachable for new readers.
+ */
+int prom_epoch_retire(prom_epoch_garbage_t *garbage, void *item, prom_epoch_free_fn free_fn);
+
+/**
+ * @brief API PRIVATE Frees every item in garbage that is no longer referenced by any reader. Never blocks.
+ */
+void prom_epoch_collect(prom_epoch_garbage_t *garbage);
+
+/**
+ * @brief API PRIVATE Frees every item in garbage immediately. The caller MUST guarantee that no reader is active.
+ */
+void prom_epoch_purge(prom_epoch_garbage_t *garbage);
+
+#endif  // PROM_EPOCH_I_H
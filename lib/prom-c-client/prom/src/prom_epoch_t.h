@@ -0,0 +1,65 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_EPOCH_T_H
+#define PROM_EPOCH_T_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief API PRIVATE Frees an item once no reader can still reference it
+ */
+typedef void (*prom_epoch_free_fn)(void *);
+
+// The size of a cache line, which records are aligned to
+#define PROM_EPOCH_CACHE_LINE 64
+
+/**
+ * @brief API PRIVATE Per-thread reader state.
+ *
+ * Records are never freed. When a thread exits its record is released and may be claimed by another thread. Each
+ * record is aligned to and fills a cache line so that readers on different threads never write to the same one.
+ */
+typedef struct prom_epoch_record {
+  _Alignas(PROM_EPOCH_CACHE_LINE) _Atomic uint64_t epoch; /**< The epoch of the read-side section, 0 if quiescent */
+  size_t depth;                   /**< Nesting depth of read-side sections. Only touched by the owning thread */
+  _Atomic bool in_use;            /**< Whether a thread currently owns this record */
+  struct prom_epoch_record *next; /**< The next record in the global list of records */
+} prom_epoch_record_t;
+
+/**
+ * @brief API PRIVATE An item waiting for every reader that might reference it to leave its read-side section
+ */
+typedef struct prom_epoch_retired {
+  void *item;
+  prom_epoch_free_fn free_fn;
+  uint64_t epoch;                   /**< The epoch at which the item was unlinked */
+  struct prom_epoch_retired *next;
+} prom_epoch_retired_t;
+
+/**
+ * @brief API PRIVATE A list of retired items. A garbage list is owned by a single writer and MUST only be modified
+ * while holding that writer's lock.
+ */
+typedef struct prom_epoch_garbage {
+  prom_epoch_retired_t *head;
+  size_t count;
+} prom_epoch_garbage_t;
+
+#endif  // PROM_EPOCH_T_H
@@ -16,8 +16,15 @@
 
 #define PROM_STDIO_CLOSE_DIR_ERROR "failed to close dir"
 #define PROM_STDIO_OPEN_DIR_ERROR "failed to open dir"
+#define PROM_HISTOGRAM_INVALID_SCHEMA "invalid sparse histogram schema"
+#define PROM_HISTOGRAM_INVALID_ZERO_THRESHOLD "invalid sparse histogram zero threshold"
+#define PROM_HISTOGRAM_INVALID_TEXT_RANGE "invalid sparse histogram text range"
 #define PROM_METRIC_INCORRECT_TYPE "incorrect metric type"
 #define PROM_METRIC_INVALID_LABEL_NAME "invalid label name"
+#define PROM_METRIC_SAMPLES_EXIST "metric already has samples"
+#define PROM_SUMMARY_INVALID_MAX_AGE "invalid summary max age"
+#define PROM_SUMMARY_INVALID_QUANTILE "invalid summary quantile"
+#define PROM_PTHREAD_CREATE_ERROR "failed to create the pthread_t"
 #define PROM_PTHREAD_RWLOCK_DESTROY_ERROR "failed to destroy the pthread_rwlock_t*"
 #define PROM_PTHREAD_RWLOCK_INIT_ERROR "failed to initialize the pthread_rwlock_t*"
 #define PROM_PTHREAD_RWLOCK_LOCK_ERROR "failed to lock the pthread_rwlock_t*"
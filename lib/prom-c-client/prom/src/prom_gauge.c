@@ -32,6 +32,10 @@ prom_gauge_t *prom_gauge_new(const char *name, const char *help, size_t label_ke
   return (prom_gauge_t *)prom_metric_new(PROM_GAUGE, name, help, label_key_count, label_keys);
 }
 
+prom_gauge_t *prom_gauge_new_func(const char *name, const char *help, prom_metric_value_fn fn, void *ctx) {
+  return (prom_gauge_t *)prom_metric_new_func(PROM_GAUGE, name, help, fn, ctx);
+}
+
 int prom_gauge_destroy(prom_gauge_t *self) {
   PROM_ASSERT(self != NULL);
   int r = 0;
@@ -47,9 +51,8 @@ int prom_gauge_inc(prom_gauge_t *self, const char **label_values) {
     PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
     return 1;
   }
-  prom_metric_sample_t *sample = prom_metric_sample_from_labels(self, label_values);
-  if (sample == NULL) return 1;
-  return prom_metric_sample_add(sample, 1.0);
+  prom_batch_update_t update = {self, label_values, PROM_BATCH_ADD, 1.0};
+  return prom_metric_update(self, 1, &update);
 }
 
 int prom_gauge_dec(prom_gauge_t *self, const char **label_values) {
@@ -59,9 +62,8 @@ int prom_gauge_dec(prom_gauge_t *self, const char **label_values) {
     PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
     return 1;
   }
-  prom_metric_sample_t *sample = prom_metric_sample_from_labels(self, label_values);
-  if (sample == NULL) return 1;
-  return prom_metric_sample_sub(sample, 1.0);
+  prom_batch_update_t update = {self, label_values, PROM_BATCH_SUB, 1.0};
+  return prom_metric_update(self, 1, &update);
 }
 
 int prom_gauge_add(prom_gauge_t *self, double r_value, const char **label_values) {
@@ -71,9 +73,8 @@ int prom_gauge_add(prom_gauge_t *self, double r_value, const char **label_values
     PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
     return 1;
   }
-  prom_metric_sample_t *sample = prom_metric_sample_from_labels(self, label_values);
-  if (sample == NULL) return 1;
-  return prom_metric_sample_add(sample, r_value);
+  prom_batch_update_t update = {self, label_values, PROM_BATCH_ADD, r_value};
+  return prom_metric_update(self, 1, &update);
 }
 
 int prom_gauge_sub(prom_gauge_t *self, double r_value, const char **label_values) {
@@ -83,9 +84,8 @@ int prom_gauge_sub(prom_gauge_t *self, double r_value, const char **label_values
     PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
     return 1;
   }
-  prom_metric_sample_t *sample = prom_metric_sample_from_labels(self, label_values);
-  if (sample == NULL) return 1;
-  return prom_metric_sample_sub(sample, r_value);
+  prom_batch_update_t update = {self, label_values, PROM_BATCH_SUB, r_value};
+  return prom_metric_update(self, 1, &update);
 }
 
 int prom_gauge_set(prom_gauge_t *self, double r_value, const char **label_values) {
@@ -95,7 +95,16 @@ int prom_gauge_set(prom_gauge_t *self, double r_value, const char **label_values
     PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
     return 1;
   }
-  prom_metric_sample_t *sample = prom_metric_sample_from_labels(self, label_values);
-  if (sample == NULL) return 1;
-  return prom_metric_sample_set(sample, r_value);
+  prom_batch_update_t update = {self, label_values, PROM_BATCH_SET, r_value};
+  return prom_metric_update(self, 1, &update);
+}
+
+prom_metric_sample_t *prom_gauge_labels(prom_gauge_t *self, const char **label_values) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return NULL;
+  if (self->type != PROM_GAUGE) {
+    PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
+    return NULL;
+  }
+  return prom_metric_sample_from_labels(self, label_values);
 }
@@ -23,6 +23,7 @@
 // Private
 #include "prom_assert.h"
 #include "prom_errors.h"
+#include "prom_histogram_sparse_i.h"
 #include "prom_log.h"
 #include "prom_map_i.h"
 #include "prom_metric_i.h"
@@ -33,6 +34,7 @@
 prom_histogram_t *prom_histogram_new(const char *name, const char *help, prom_histogram_buckets_t *buckets,
                                      size_t label_key_count, const char **label_keys) {
   prom_histogram_t *self = (prom_histogram_t *)prom_metric_new(PROM_HISTOGRAM, name, help, label_key_count, label_keys);
+  if (self == NULL) return NULL;
   if (buckets == NULL) {
     if (!prom_histogram_default_buckets) {
       prom_histogram_default_buckets = prom_histogram_buckets_new(11,
@@ -54,6 +56,21 @@ prom_histogram_t *prom_histogram_new(const char *name, const char *help, prom_hi
   return self;
 }
 
+prom_histogram_t *prom_histogram_new_sparse(const char *name, const char *help, int schema, double zero_threshold,
+                                            double text_low, double text_high, size_t label_key_count,
+                                            const char **label_keys) {
+  prom_histogram_sparse_t *sparse = prom_histogram_sparse_new(schema, zero_threshold, text_low, text_high);
+  if (sparse == NULL) return NULL;
+
+  prom_histogram_t *self = (prom_histogram_t *)prom_metric_new(PROM_HISTOGRAM, name, help, label_key_count, label_keys);
+  if (self == NULL) {
+    prom_histogram_sparse_destroy(sparse);
+    return NULL;
+  }
+  self->sparse = sparse;
+  return self;
+}
+
 int prom_histogram_destroy(prom_histogram_t *self) {
   PROM_ASSERT(self != NULL);
 
@@ -73,7 +90,16 @@ int prom_histogram_observe(prom_histogram_t *self, double value, const char **la
     PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
     return 1;
   }
-  prom_metric_sample_histogram_t *h_sample = prom_metric_sample_histogram_from_labels(self, label_values);
-  if (h_sample == NULL) return 1;
-  return prom_metric_sample_histogram_observe(h_sample, value);
+  prom_batch_update_t update = {self, label_values, PROM_BATCH_OBSERVE, value};
+  return prom_metric_update(self, 1, &update);
+}
+
+prom_metric_sample_histogram_t *prom_histogram_labels(prom_histogram_t *self, const char **label_values) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return NULL;
+  if (self->type != PROM_HISTOGRAM) {
+    PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
+    return NULL;
+  }
+  return prom_metric_sample_histogram_from_labels(self, label_values);
 }
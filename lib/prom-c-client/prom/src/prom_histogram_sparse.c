@@ -0,0 +1,171 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <math.h>
+#include <stdint.h>
+
+// Public
+#include "prom_alloc.h"
+#include "prom_histogram.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_errors.h"
+#include "prom_histogram_sparse_i.h"
+#include "prom_log.h"
+
+/**
+ * @brief API PRIVATE Returns the index of the bucket that the bucket with the given index falls in at a schema coarser
+ * by shift. A coarser bucket merges 2^shift buckets and shares its upper bound with the last of them.
+ */
+static inline int32_t prom_histogram_sparse_coarsen(int32_t index, int shift) {
+  return (index + (1 << shift) - 1) >> shift;
+}
+
+/**
+ * @brief API PRIVATE Returns the upper bound of the positive bucket with the given index, which is also the lower bound
+ * of the bucket after it
+ */
+static double prom_histogram_sparse_upper_bound(prom_histogram_sparse_t *self, int32_t index) {
+  PROM_ASSERT(self != NULL);
+  if (self->schema <= 0) return ldexp(1.0, index * (1 << -self->schema));
+
+  int32_t count = (int32_t)self->bound_count;
+  int32_t exp = index >= 0 ? index / count : -((-index + count - 1) / count);
+  return ldexp(self->bounds[index - exp * count], exp + 1);
+}
+
+/**
+ * @brief API PRIVATE Sets up the text buckets of self, whose schema and zero threshold are set, for the range text_low
+ * to text_high. Returns non-zero upon failure, e.g. if no schema fits the range in
+ * PROM_HISTOGRAM_SPARSE_TEXT_BUCKETS_MAX buckets.
+ */
+static int prom_histogram_sparse_text_init(prom_histogram_sparse_t *self, double text_low, double text_high) {
+  // The finest schema that fits is used. A coarser schema only merges buckets, so its bounds are bounds of schema too.
+  int32_t low = prom_histogram_sparse_index(self, text_low);
+  int32_t high = prom_histogram_sparse_index(self, text_high);
+  int shift = 0;
+  while (prom_histogram_sparse_coarsen(high, shift) - prom_histogram_sparse_coarsen(low, shift) + 1 >
+         PROM_HISTOGRAM_SPARSE_TEXT_BUCKETS_MAX) {
+    if (self->schema - shift == PROM_HISTOGRAM_SPARSE_SCHEMA_MIN) {
+      PROM_LOG(PROM_HISTOGRAM_INVALID_TEXT_RANGE);
+      return 1;
+    }
+    shift++;
+  }
+
+  self->text_schema = self->schema - shift;
+  self->text_first = prom_histogram_sparse_coarsen(low, shift);
+  self->text_count = (size_t)(prom_histogram_sparse_coarsen(high, shift) - self->text_first + 1);
+  self->text_bounds = (double *)prom_malloc(sizeof(double) * self->text_count);
+  if (self->text_bounds == NULL) return 1;
+  for (size_t i = 0; i < self->text_count; i++) {
+    int32_t index = (self->text_first + (int32_t)i) * (1 << shift);
+    self->text_bounds[i] = prom_histogram_sparse_upper_bound(self, index);
+  }
+  return 0;
+}
+
+prom_histogram_sparse_t *prom_histogram_sparse_new(int schema, double zero_threshold, double text_low,
+                                                   double text_high) {
+  if (schema < PROM_HISTOGRAM_SPARSE_SCHEMA_MIN || schema > PROM_HISTOGRAM_SPARSE_SCHEMA_MAX) {
+    PROM_LOG(PROM_HISTOGRAM_INVALID_SCHEMA);
+    return NULL;
+  }
+  if (!(zero_threshold >= 0)) {
+    PROM_LOG(PROM_HISTOGRAM_INVALID_ZERO_THRESHOLD);
+    return NULL;
+  }
+  // The zero bucket cannot be split, so it MUST lie below the lowest le value
+  if (!(text_low > 0 && text_low >= zero_threshold && text_low <= text_high && isfinite(text_high))) {
+    PROM_LOG(PROM_HISTOGRAM_INVALID_TEXT_RANGE);
+    return NULL;
+  }
+
+  prom_histogram_sparse_t *self = (prom_histogram_sparse_t *)prom_malloc(sizeof(prom_histogram_sparse_t));
+  if (self == NULL) return NULL;
+  self->schema = schema;
+  self->zero_threshold = zero_threshold;
+  self->bound_count = 0;
+  self->bounds = NULL;
+  self->text_bounds = NULL;
+
+  // Finer schemas split every power of two the same way, so the split is computed once and scaled by frexp
+  if (schema > 0) {
+    self->bound_count = (size_t)1 << schema;
+    self->bounds = (double *)prom_malloc(sizeof(double) * self->bound_count);
+    if (self->bounds == NULL) {
+      prom_histogram_sparse_destroy(self);
+      return NULL;
+    }
+    for (size_t i = 0; i < self->bound_count; i++) {
+      self->bounds[i] = exp2((double)i / (double)self->bound_count) / 2;
+    }
+  }
+
+  if (prom_histogram_sparse_text_init(self, text_low, text_high)) {
+    prom_histogram_sparse_destroy(self);
+    return NULL;
+  }
+  return self;
+}
+
+int prom_histogram_sparse_destroy(prom_histogram_sparse_t *self) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 0;
+  prom_free(self->bounds);
+  self->bounds = NULL;
+  prom_free(self->text_bounds);
+  self->text_bounds = NULL;
+  prom_free(self);
+  self = NULL;
+  return 0;
+}
+
+int32_t prom_histogram_sparse_index(prom_histogram_sparse_t *self, double magnitude) {
+  PROM_ASSERT(self != NULL);
+  int exp = 0;
+  double frac = frexp(magnitude, &exp);
+
+  if (self->schema > 0) {
+    // Binary search for the first bound at or above frac, so that exact powers of the base land on their own bucket
+    size_t low = 0;
+    size_t high = self->bound_count;
+    while (low < high) {
+      size_t mid = (low + high) / 2;
+      if (self->bounds[mid] < frac) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return (int32_t)low + (exp - 1) * (int32_t)self->bound_count;
+  }
+
+  // A coarser schema merges 2^-schema powers of two into one bucket. An exact power of two belongs to the bucket
+  // below it.
+  int32_t index = frac == 0.5 ? exp - 1 : exp;
+  return prom_histogram_sparse_coarsen(index, -self->schema);
+}
+
+size_t prom_histogram_sparse_text_bucket(prom_histogram_sparse_t *self, int32_t index) {
+  PROM_ASSERT(self != NULL);
+  int32_t text_index = prom_histogram_sparse_coarsen(index, self->schema - self->text_schema);
+  if (text_index < self->text_first) return 0;
+  size_t bucket = (size_t)(text_index - self->text_first);
+  return bucket < self->text_count ? bucket : self->text_count;
+}
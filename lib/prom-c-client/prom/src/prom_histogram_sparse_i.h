@@ -0,0 +1,51 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PROM_HISTOGRAM_SPARSE_I_H
+#define PROM_HISTOGRAM_SPARSE_I_H
+
+#include <stdint.h>
+
+// Private
+#include "prom_histogram_sparse_t.h"
+
+/**
+ * @brief API PRIVATE Returns the layout of a sparse histogram with the given schema and zero threshold whose text
+ * buckets span text_low to text_high, or NULL if the schema is out of range, the threshold is negative or the range is
+ * invalid
+ */
+prom_histogram_sparse_t *prom_histogram_sparse_new(int schema, double zero_threshold, double text_low,
+                                                   double text_high);
+
+/**
+ * @brief API PRIVATE Destroys a prom_histogram_sparse_t*
+ */
+int prom_histogram_sparse_destroy(prom_histogram_sparse_t *self);
+
+/**
+ * @brief API PRIVATE Returns the index of the bucket that magnitude, a positive finite value, falls in. The same index
+ * is used for the positive and the negative bucket.
+ */
+int32_t prom_histogram_sparse_index(prom_histogram_sparse_t *self, double magnitude);
+
+/**
+ * @brief API PRIVATE Returns the text bucket that the positive bucket with the given index falls in, from 0 for the
+ * lowest le value to text_count for the observations above every le value
+ */
+size_t prom_histogram_sparse_text_bucket(prom_histogram_sparse_t *self, int32_t index);
+
+#endif  // PROM_HISTOGRAM_SPARSE_I_H
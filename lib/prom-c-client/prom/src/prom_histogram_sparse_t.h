@@ -0,0 +1,45 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PROM_HISTOGRAM_SPARSE_T_H
+#define PROM_HISTOGRAM_SPARSE_T_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief API PRIVATE The bucket layout of a sparse histogram, shared by all of its series.
+ *
+ * Bucket i of the positive buckets holds the observations in (2^((i-1)/2^schema), 2^(i/2^schema)], and bucket i of
+ * the negative buckets mirrors it. Observations no further from zero than zero_threshold go to the zero bucket.
+ *
+ * The text format only has classic buckets, which every series of the metric exposes with the same le values: the
+ * upper bounds of the buckets text_first to text_first + text_count - 1 of the coarser text_schema. Each of them is
+ * also the upper bound of a bucket of schema, so their counts are exact sums of buckets.
+ */
+typedef struct prom_histogram_sparse {
+  int schema;            /**< the resolution. Each power of two is split into 2^schema buckets */
+  double zero_threshold; /**< the upper bound of the zero bucket */
+  size_t bound_count;    /**< the number of bounds, 2^schema for a positive schema and 0 otherwise */
+  double *bounds;        /**< the upper bounds of the buckets within one power of two, scaled into [0.5, 1) */
+  int text_schema;       /**< the resolution of the text buckets, at most schema */
+  int32_t text_first;    /**< the index of the lowest text bucket at text_schema */
+  size_t text_count;     /**< the number of text buckets, +Inf aside */
+  double *text_bounds;   /**< the le values of the text buckets, from the lowest up */
+} prom_histogram_sparse_t;
+
+#endif  // PROM_HISTOGRAM_SPARSE_T_H
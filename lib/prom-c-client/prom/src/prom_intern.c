@@ -0,0 +1,134 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+// Public
+#include "prom_alloc.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_intern_i.h"
+#include "prom_intern_t.h"
+#include "prom_map_i.h"
+
+#define PROM_INTERN_INITIAL_BUCKETS 64
+
+static prom_intern_table_t prom_intern_table = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0};
+
+static inline prom_intern_entry_t *prom_intern_entry_of(const char *str) {
+  return (prom_intern_entry_t *)(str - offsetof(prom_intern_entry_t, str));
+}
+
+static inline size_t prom_intern_entry_size(size_t len) { return offsetof(prom_intern_entry_t, str) + len + 1; }
+
+/**
+ * @brief API PRIVATE Doubles the bucket array of the table. The caller MUST hold the table lock.
+ */
+static int prom_intern_grow_internal(prom_intern_table_t *table) {
+  size_t bucket_count = table->bucket_count ? table->bucket_count * 2 : PROM_INTERN_INITIAL_BUCKETS;
+  prom_intern_entry_t **buckets = (prom_intern_entry_t **)prom_calloc(bucket_count, sizeof(prom_intern_entry_t *));
+  if (buckets == NULL) return 1;
+
+  for (size_t i = 0; i < table->bucket_count; i++) {
+    prom_intern_entry_t *entry = table->buckets[i];
+    while (entry != NULL) {
+      prom_intern_entry_t *next = entry->next;
+      size_t index = entry->hash & (bucket_count - 1);
+      entry->next = buckets[index];
+      buckets[index] = entry;
+      entry = next;
+    }
+  }
+  prom_free(table->buckets);
+  table->buckets = buckets;
+  table->bucket_count = bucket_count;
+  return 0;
+}
+
+const char *prom_intern(const char *str) {
+  PROM_ASSERT(str != NULL);
+  if (str == NULL) return NULL;
+
+  prom_map_hash_init();
+  size_t len = strlen(str);
+  uint64_t hash = prom_map_hash(str, len);
+  prom_intern_table_t *table = &prom_intern_table;
+
+  pthread_mutex_lock(&table->lock);
+  if (table->count >= table->bucket_count) {
+    // Failing to grow only matters when there are no buckets at all yet
+    if (prom_intern_grow_internal(table) && table->buckets == NULL) {
+      pthread_mutex_unlock(&table->lock);
+      return NULL;
+    }
+  }
+
+  prom_intern_entry_t **bucket = &table->buckets[hash & (table->bucket_count - 1)];
+  for (prom_intern_entry_t *entry = *bucket; entry != NULL; entry = entry->next) {
+    if (entry->hash == hash && entry->len == len && memcmp(entry->str, str, len) == 0) {
+      atomic_fetch_add_explicit(&entry->refs, 1, memory_order_relaxed);
+      pthread_mutex_unlock(&table->lock);
+      return entry->str;
+    }
+  }
+
+  prom_intern_entry_t *entry = (prom_intern_entry_t *)prom_malloc(prom_intern_entry_size(len));
+  if (entry == NULL) {
+    pthread_mutex_unlock(&table->lock);
+    return NULL;
+  }
+  entry->hash = hash;
+  atomic_init(&entry->refs, 1);
+  entry->len = len;
+  memcpy(entry->str, str, len + 1);
+  entry->next = *bucket;
+  *bucket = entry;
+  table->count++;
+  pthread_mutex_unlock(&table->lock);
+  return entry->str;
+}
+
+void prom_intern_release(const char *str) {
+  if (str == NULL) return;
+  prom_intern_entry_t *entry = prom_intern_entry_of(str);
+
+  // Dropping a reference that is not the last one needs no lock
+  size_t refs = atomic_load_explicit(&entry->refs, memory_order_relaxed);
+  while (refs > 1) {
+    if (atomic_compare_exchange_weak_explicit(&entry->refs, &refs, refs - 1, memory_order_release,
+                                              memory_order_relaxed)) {
+      return;
+    }
+  }
+
+  // The last reference may race with prom_intern handing out a new one, which only happens under the lock
+  prom_intern_table_t *table = &prom_intern_table;
+  pthread_mutex_lock(&table->lock);
+  if (atomic_fetch_sub_explicit(&entry->refs, 1, memory_order_acq_rel) != 1) {
+    pthread_mutex_unlock(&table->lock);
+    return;
+  }
+  prom_intern_entry_t **link = &table->buckets[entry->hash & (table->bucket_count - 1)];
+  while (*link != entry) link = &(*link)->next;
+  *link = entry->next;
+  table->count--;
+  pthread_mutex_unlock(&table->lock);
+  prom_free(entry);
+}
@@ -0,0 +1,35 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_INTERN_I_INCLUDED
+#define PROM_INTERN_I_INCLUDED
+
+/**
+ * @brief API PRIVATE Returns the shared copy of str, creating it if needed, and takes a reference to it.
+ *
+ * Equal strings interned anywhere in the process share one copy. The result MUST NOT be modified and MUST be handed
+ * back with prom_intern_release.
+ *
+ * @return The interned string, or NULL upon failure
+ */
+const char *prom_intern(const char *str);
+
+/**
+ * @brief API PRIVATE Drops a reference taken by prom_intern. NULL is ignored.
+ */
+void prom_intern_release(const char *str);
+
+#endif  // PROM_INTERN_I_INCLUDED
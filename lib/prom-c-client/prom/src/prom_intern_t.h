@@ -0,0 +1,50 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_INTERN_T_H
+#define PROM_INTERN_T_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief API PRIVATE A string shared by everything that interned it. The string is stored inline after the struct and
+ * callers only ever see a pointer to it.
+ */
+typedef struct prom_intern_entry {
+  struct prom_intern_entry *next; /**< the next entry in the same bucket */
+  uint64_t hash;                  /**< hash of str */
+  _Atomic size_t refs;            /**< the number of references handed out. The entry is freed when this drops to 0 */
+  size_t len;                     /**< length of str, excluding the terminating NUL */
+  char str[];                     /**< NUL-terminated string */
+} prom_intern_entry_t;
+
+/**
+ * @brief API PRIVATE The process-wide table of interned strings.
+ *
+ * Label keys are interned when metrics are created and released when they are destroyed, never on the update path, so
+ * a single mutex is enough.
+ */
+typedef struct prom_intern_table {
+  pthread_mutex_t lock;           /**< guards everything below and any refs that may drop to 0 */
+  prom_intern_entry_t **buckets;  /**< chains of entries. NULL until the first string is interned */
+  size_t bucket_count;            /**< the number of buckets. This is always a power of two */
+  size_t count;                   /**< the number of entries */
+} prom_intern_table_t;
+
+#endif  // PROM_INTERN_T_H
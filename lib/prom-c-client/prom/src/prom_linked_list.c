@@ -22,9 +22,10 @@
 #include "prom_linked_list_i.h"
 #include "prom_linked_list_t.h"
 #include "prom_log.h"
+#include "prom_pool_i.h"
 
 prom_linked_list_t *prom_linked_list_new(void) {
-  prom_linked_list_t *self = (prom_linked_list_t *)prom_malloc(sizeof(prom_linked_list_t));
+  prom_linked_list_t *self = (prom_linked_list_t *)prom_pool_alloc(sizeof(prom_linked_list_t));
   self->head = NULL;
   self->tail = NULL;
   self->free_fn = NULL;
@@ -46,7 +47,7 @@ int prom_linked_list_purge(prom_linked_list_t *self) {
         prom_free(node->item);
       }
     }
-    prom_free(node);
+    prom_pool_free(node, sizeof(prom_linked_list_node_t));
     node = NULL;
     node = next;
   }
@@ -63,7 +64,7 @@ int prom_linked_list_destroy(prom_linked_list_t *self) {
 
   r = prom_linked_list_purge(self);
   if (r) ret = r;
-  prom_free(self);
+  prom_pool_free(self, sizeof(prom_linked_list_t));
   self = NULL;
   return ret;
 }
@@ -89,7 +90,7 @@ void *prom_linked_list_last(prom_linked_list_t *self) {
 int prom_linked_list_append(prom_linked_list_t *self, void *item) {
   PROM_ASSERT(self != NULL);
   if (self == NULL) return 1;
-  prom_linked_list_node_t *node = (prom_linked_list_node_t *)prom_malloc(sizeof(prom_linked_list_node_t));
+  prom_linked_list_node_t *node = (prom_linked_list_node_t *)prom_pool_alloc(sizeof(prom_linked_list_node_t));
 
   node->item = item;
   if (self->tail) {
@@ -106,7 +107,7 @@ int prom_linked_list_append(prom_linked_list_t *self, void *item) {
 int prom_linked_list_push(prom_linked_list_t *self, void *item) {
   PROM_ASSERT(self != NULL);
   if (self == NULL) return 1;
-  prom_linked_list_node_t *node = (prom_linked_list_node_t *)prom_malloc(sizeof(prom_linked_list_node_t));
+  prom_linked_list_node_t *node = (prom_linked_list_node_t *)prom_pool_alloc(sizeof(prom_linked_list_node_t));
 
   node->item = item;
   node->next = self->head;
@@ -136,7 +137,7 @@ void *prom_linked_list_pop(prom_linked_list_t *self) {
         prom_free(node->item);
       }
     }
-    node->item = NULL;
+    prom_pool_free(node, sizeof(prom_linked_list_node_t));
     node = NULL;
     self->size--;
   }
@@ -183,7 +184,7 @@ int prom_linked_list_remove(prom_linked_list_t *self, void *item) {
   }
 
   node->item = NULL;
-  prom_free(node);
+  prom_pool_free(node, sizeof(prom_linked_list_node_t));
   node = NULL;
   self->size--;
   return 0;
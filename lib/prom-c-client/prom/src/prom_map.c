@@ -15,58 +15,182 @@
  */
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+#include <unistd.h>
 
 // Public
 #include "prom_alloc.h"
 
 // Private
 #include "prom_assert.h"
+#include "prom_epoch_i.h"
 #include "prom_errors.h"
-#include "prom_linked_list_i.h"
-#include "prom_linked_list_t.h"
 #include "prom_log.h"
 #include "prom_map_i.h"
 #include "prom_map_t.h"
+#include "prom_pool_i.h"
 
+// The initial number of slots. This MUST be a power of two.
 #define PROM_MAP_INITIAL_SIZE 32
 
+// The number of old slots each write migrates while a resize is in progress. This MUST be at least 4 so that a
+// migration always completes before the new table is half full.
+#define PROM_MAP_MIGRATE_STEP 64
+
+// The largest number of shards a sharded map may be split into
+#define PROM_MAP_MAX_SHARDS 1024
+
+// The initial capacity of the order array
+#define PROM_MAP_INITIAL_ORDER_SIZE 16
+
+// Marks a slot whose entry has been deleted. Probe sequences continue past tombstones.
+static prom_map_entry_t prom_map_tombstone;
+
+#define PROM_MAP_ENTRY_IS_LIVE(entry) ((entry) != NULL && (entry) != &prom_map_tombstone)
+
 static void destroy_map_node_value_no_op(void *value) {}
 
+static void prom_map_free_generic(void *item) { prom_free(item); }
+
+static prom_map_entry_t *prom_map_entry_new(size_t len) {
+  return (prom_map_entry_t *)prom_pool_alloc(sizeof(prom_map_entry_t) + len + 1);
+}
+
+static void prom_map_entry_free(void *item) {
+  prom_map_entry_t *entry = (prom_map_entry_t *)item;
+  prom_pool_free(entry, sizeof(prom_map_entry_t) + entry->len + 1);
+}
+
+/**
+ * @brief API PRIVATE Allocates a table of empty slots.
+ *
+ * The slots are zeroed by calloc rather than initialized one by one. For large tables this lets the allocator hand
+ * back fresh zero pages, so installing a new table during a resize does not cost time proportional to its size.
+ */
+static prom_map_table_t *prom_map_table_new(size_t max_size) {
+  prom_map_table_t *table =
+      (prom_map_table_t *)prom_calloc(1, sizeof(prom_map_table_t) + sizeof(prom_map_node_t) * max_size);
+  if (table == NULL) return NULL;
+  table->max_size = max_size;
+  atomic_init(&table->from, NULL);
+  return table;
+}
+
+static prom_map_order_t *prom_map_order_new(size_t capacity) {
+  size_t size = sizeof(prom_map_order_t) + sizeof(prom_map_entry_t *) * capacity;
+  prom_map_order_t *order = (prom_map_order_t *)prom_pool_alloc(size);
+  if (order == NULL) return NULL;
+  memset(order, 0, size);
+  order->capacity = capacity;
+  atomic_init(&order->count, 0);
+  return order;
+}
+
+static void prom_map_order_free(void *item) {
+  prom_map_order_t *order = (prom_map_order_t *)item;
+  prom_pool_free(order, sizeof(prom_map_order_t) + sizeof(prom_map_entry_t *) * order->capacity);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// prom_map_node
+// Hashing
+//
+// Keys are hashed eight bytes at a time with a wyhash-style multiply/fold mixer. The seed is drawn from the kernel the
+// first time a map is created so that label values supplied by scraped clients cannot be chosen to collide.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-prom_map_node_t *prom_map_node_new(const char *key, void *value, prom_map_node_free_value_fn free_value_fn) {
-  prom_map_node_t *self = prom_malloc(sizeof(prom_map_node_t));
-  self->key = prom_strdup(key);
-  self->value = value;
-  self->free_value_fn = free_value_fn;
-  return self;
+static const uint64_t prom_map_hash_secret[4] = {0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL,
+                                                 0x589965cc75374cc3ULL};
+
+static uint64_t prom_map_hash_seed = 0;
+static pthread_once_t prom_map_hash_seed_once = PTHREAD_ONCE_INIT;
+
+static void prom_map_hash_seed_init(void) {
+  uint64_t seed = 0;
+  if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) != sizeof(seed)) {
+    // Fall back to something that at least differs between processes.
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    seed = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec ^ ((uint64_t)getpid() << 16) ^ (uintptr_t)&seed;
+  }
+  prom_map_hash_seed = seed;
 }
 
-int prom_map_node_destroy(prom_map_node_t *self) {
-  PROM_ASSERT(self != NULL);
-  if (self == NULL) return 0;
-  prom_free((void *)self->key);
-  self->key = NULL;
-  if (self->value != NULL) (*self->free_value_fn)(self->value);
-  self->value = NULL;
-  prom_free(self);
-  self = NULL;
-  return 0;
+static inline void prom_map_hash_mum(uint64_t *a, uint64_t *b) {
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t prom_map_hash_mix(uint64_t a, uint64_t b) {
+  prom_map_hash_mum(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t prom_map_hash_read8(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
 }
 
-void prom_map_node_free(void *item) {
-  prom_map_node_t *map_node = (prom_map_node_t *)item;
-  prom_map_node_destroy(map_node);
+static inline uint64_t prom_map_hash_read4(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
 }
 
-prom_linked_list_compare_t prom_map_node_compare(void *item_a, void *item_b) {
-  prom_map_node_t *map_node_a = (prom_map_node_t *)item_a;
-  prom_map_node_t *map_node_b = (prom_map_node_t *)item_b;
+void prom_map_hash_init(void) { pthread_once(&prom_map_hash_seed_once, prom_map_hash_seed_init); }
+
+/**
+ * @brief API PRIVATE Hashes the first len bytes of key. Only valid after prom_map_hash_init has run at least once.
+ */
+uint64_t prom_map_hash(const char *key, size_t len) {
+  const unsigned char *p = (const unsigned char *)key;
+  const uint64_t *secret = prom_map_hash_secret;
+  uint64_t seed = prom_map_hash_seed ^ prom_map_hash_mix(prom_map_hash_seed ^ secret[0], secret[1]);
+  uint64_t a, b;
+
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t off = (len >> 3) << 2;
+      a = (prom_map_hash_read4(p) << 32) | prom_map_hash_read4(p + off);
+      b = (prom_map_hash_read4(p + len - 4) << 32) | prom_map_hash_read4(p + len - 4 - off);
+    } else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = prom_map_hash_mix(prom_map_hash_read8(p) ^ secret[1], prom_map_hash_read8(p + 8) ^ seed);
+        see1 = prom_map_hash_mix(prom_map_hash_read8(p + 16) ^ secret[2], prom_map_hash_read8(p + 24) ^ see1);
+        see2 = prom_map_hash_mix(prom_map_hash_read8(p + 32) ^ secret[3], prom_map_hash_read8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = prom_map_hash_mix(prom_map_hash_read8(p) ^ secret[1], prom_map_hash_read8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = prom_map_hash_read8(p + i - 16);
+    b = prom_map_hash_read8(p + i - 8);
+  }
 
-  return strcmp(map_node_a->key, map_node_b->key);
+  a ^= secret[1];
+  b ^= seed;
+  prom_map_hash_mum(&a, &b);
+  return prom_map_hash_mix(a ^ secret[0] ^ len, b ^ secret[1]);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -76,42 +200,47 @@ prom_linked_list_compare_t prom_map_node_compare(void *item_a, void *item_b) {
 prom_map_t *prom_map_new() {
   int r = 0;
 
-  prom_map_t *self = (prom_map_t *)prom_malloc(sizeof(prom_map_t));
-  self->size = 0;
-  self->max_size = PROM_MAP_INITIAL_SIZE;
+  prom_map_hash_init();
 
-  self->keys = prom_linked_list_new();
-  if (self->keys == NULL) return NULL;
+  prom_map_t *self = (prom_map_t *)prom_pool_alloc(sizeof(prom_map_t));
+  if (self == NULL) return NULL;
+  self->size = 0;
+  self->used = 0;
+  atomic_init(&self->table, NULL);
+  self->migrate_index = 0;
+  atomic_init(&self->order, NULL);
+  self->garbage.head = NULL;
+  self->garbage.count = 0;
+  self->rwlock = NULL;
+  self->free_value_fn = destroy_map_node_value_no_op;
+  self->shards = NULL;
+  self->shard_count = 0;
+  self->shard_shift = 0;
 
-  // These each key will be allocated once by prom_map_node_new and used here as well to save memory. With that said
-  // we will only have to deallocate each key once. That will happen on prom_map_node_destroy.
-  r = prom_linked_list_set_free_fn(self->keys, prom_linked_list_no_op_free);
-  if (r) {
+  prom_map_table_t *table = prom_map_table_new(PROM_MAP_INITIAL_SIZE);
+  if (table == NULL) {
     prom_map_destroy(self);
     return NULL;
   }
+  atomic_store(&self->table, table);
 
-  self->addrs = prom_malloc(sizeof(prom_linked_list_t) * self->max_size);
-  self->free_value_fn = destroy_map_node_value_no_op;
-
-  for (int i = 0; i < self->max_size; i++) {
-    self->addrs[i] = prom_linked_list_new();
-    r = prom_linked_list_set_free_fn(self->addrs[i], prom_map_node_free);
-    if (r) {
-      prom_map_destroy(self);
-      return NULL;
-    }
-    r = prom_linked_list_set_compare_fn(self->addrs[i], prom_map_node_compare);
-    if (r) {
-      prom_map_destroy(self);
-      return NULL;
-    }
+  prom_map_order_t *order = prom_map_order_new(PROM_MAP_INITIAL_ORDER_SIZE);
+  if (order == NULL) {
+    prom_map_destroy(self);
+    return NULL;
   }
+  atomic_store(&self->order, order);
 
-  self->rwlock = (pthread_rwlock_t *)prom_malloc(sizeof(pthread_rwlock_t));
+  self->rwlock = (pthread_rwlock_t *)prom_pool_alloc(sizeof(pthread_rwlock_t));
+  if (self->rwlock == NULL) {
+    prom_map_destroy(self);
+    return NULL;
+  }
   r = pthread_rwlock_init(self->rwlock, NULL);
   if (r) {
     PROM_LOG(PROM_PTHREAD_RWLOCK_INIT_ERROR);
+    prom_pool_free(self->rwlock, sizeof(pthread_rwlock_t));
+    self->rwlock = NULL;
     prom_map_destroy(self);
     return NULL;
   }
@@ -119,209 +248,348 @@ prom_map_t *prom_map_new() {
   return self;
 }
 
+prom_map_t *prom_map_new_sharded(size_t shard_count) {
+  if (shard_count <= 1) return prom_map_new();
+  if (shard_count > PROM_MAP_MAX_SHARDS) shard_count = PROM_MAP_MAX_SHARDS;
+
+  size_t shard_bits = 0;
+  while (((size_t)1 << shard_bits) < shard_count) shard_bits++;
+
+  prom_map_t *self = (prom_map_t *)prom_pool_alloc(sizeof(prom_map_t));
+  if (self == NULL) return NULL;
+  self->size = 0;
+  self->used = 0;
+  atomic_init(&self->table, NULL);
+  self->migrate_index = 0;
+  atomic_init(&self->order, NULL);
+  self->garbage.head = NULL;
+  self->garbage.count = 0;
+  self->rwlock = NULL;
+  self->free_value_fn = destroy_map_node_value_no_op;
+  self->shard_count = (size_t)1 << shard_bits;
+  self->shard_shift = 64 - shard_bits;
+
+  self->shards = (prom_map_t **)prom_calloc(self->shard_count, sizeof(prom_map_t *));
+  if (self->shards == NULL) {
+    prom_pool_free(self, sizeof(prom_map_t));
+    return NULL;
+  }
+  for (size_t i = 0; i < self->shard_count; i++) {
+    self->shards[i] = prom_map_new();
+    if (self->shards[i] == NULL) {
+      prom_map_destroy(self);
+      return NULL;
+    }
+  }
+
+  return self;
+}
+
+/**
+ * @brief API PRIVATE Returns the shard of self responsible for hash, or self if it is not sharded.
+ *
+ * Shards are selected by the top bits of the hash while slots within a table are selected by the bottom bits, so the
+ * two choices stay independent.
+ */
+static inline prom_map_t *prom_map_shard_internal(prom_map_t *self, uint64_t hash) {
+  if (self->shards == NULL) return self;
+  return self->shards[hash >> self->shard_shift];
+}
+
 int prom_map_destroy(prom_map_t *self) {
   PROM_ASSERT(self != NULL);
   int r = 0;
   int ret = 0;
 
-  r = prom_linked_list_destroy(self->keys);
-  if (r) ret = r;
-  self->keys = NULL;
+  if (self->shards != NULL) {
+    for (size_t i = 0; i < self->shard_count; i++) {
+      if (self->shards[i] == NULL) continue;
+      r = prom_map_destroy(self->shards[i]);
+      if (r) ret = r;
+    }
+    prom_free(self->shards);
+    self->shards = NULL;
+  }
 
-  for (size_t i = 0; i < self->max_size; i++) {
-    r = prom_linked_list_destroy(self->addrs[i]);
-    if (r) ret = r;
-    self->addrs[i] = NULL;
+  // The map is being destroyed, so there can be no readers left to protect
+  prom_epoch_purge(&self->garbage);
+
+  // Every live entry appears exactly once in the order array, whichever table its slot is in
+  prom_map_order_t *order = atomic_load(&self->order);
+  if (order != NULL) {
+    size_t count = atomic_load_explicit(&order->count, memory_order_relaxed);
+    for (size_t i = 0; i < count; i++) {
+      prom_map_entry_t *entry = atomic_load_explicit(&order->entries[i], memory_order_relaxed);
+      if (entry == NULL) continue;
+      void *value = atomic_load_explicit(&entry->value, memory_order_relaxed);
+      if (value != NULL) (*self->free_value_fn)(value);
+      prom_map_entry_free(entry);
+    }
+    prom_map_order_free(order);
+    atomic_store(&self->order, NULL);
   }
-  prom_free(self->addrs);
-  self->addrs = NULL;
 
-  r = pthread_rwlock_destroy(self->rwlock);
-  if (r) {
-    PROM_LOG(PROM_PTHREAD_RWLOCK_DESTROY_ERROR)
-    ret = r;
+  prom_map_table_t *table = atomic_load(&self->table);
+  if (table != NULL) {
+    prom_map_table_t *from = atomic_load(&table->from);
+    if (from != NULL) prom_free(from);
+    prom_free(table);
+    atomic_store(&self->table, NULL);
   }
 
-  prom_free(self->rwlock);
-  self->rwlock = NULL;
-  prom_free(self);
+  if (self->rwlock != NULL) {
+    r = pthread_rwlock_destroy(self->rwlock);
+    if (r) {
+      PROM_LOG(PROM_PTHREAD_RWLOCK_DESTROY_ERROR)
+      ret = r;
+    }
+    prom_pool_free(self->rwlock, sizeof(pthread_rwlock_t));
+    self->rwlock = NULL;
+  }
+
+  prom_pool_free(self, sizeof(prom_map_t));
   self = NULL;
 
   return ret;
 }
 
-static size_t prom_map_get_index_internal(const char *key, size_t *size, size_t *max_size) {
-  size_t index;
-  size_t a = 31415, b = 27183;
-  for (index = 0; *key != '\0'; key++, a = a * b % (*max_size - 1)) {
-    index = (a * index + *key) % *max_size;
+/**
+ * @brief API PRIVATE Returns the slot holding key and stores its entry in entry_out, or NULL if the key is not present.
+ *
+ * The entry is returned separately because the slot may be tombstoned by a concurrent migration right after it is
+ * found, while the entry itself stays valid for the rest of the epoch read-side section. Slots are probed linearly
+ * starting at the index selected by the low bits of the hash. The caller's key is compared in place, and only against
+ * entries whose cached hash and length both match, so probing never allocates. This is safe to call without holding
+ * the lock from within an epoch read-side section.
+ */
+static prom_map_node_t *prom_map_find_internal(prom_map_table_t *table, const char *key, size_t len, uint64_t hash,
+                                               prom_map_entry_t **entry_out) {
+  size_t mask = table->max_size - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    prom_map_node_t *node = &table->nodes[i];
+    prom_map_entry_t *entry = atomic_load_explicit(&node->entry, memory_order_acquire);
+    if (entry == NULL) return NULL;
+    if (node->hash == hash && entry != &prom_map_tombstone && entry->len == len && memcmp(entry->key, key, len) == 0) {
+      *entry_out = entry;
+      return node;
+    }
   }
-  return index;
 }
 
 /**
- * @brief API PRIVATE hash function that returns an array index from the given key and prom_map.
- *
- * The algorithm is based off of Horner's method. In a simpler version, you set the return value to 0. Next, for each
- * character in the string, you add the integer value of the current character to the product of the prime number and
- * the current return value, set the result to the return value, then finally return the return value.
- *
- * In this version of the algorithm, we attempt to achieve a probabily of key to index conversion collisions to
- * 1/M (with M being the max_size of the map). This optimizes dispersion and consequently, evens out the performance
- * for gets and sets for each item. Instead of using a fixed prime number, we generate a coefficient for each iteration
- * through the loop.
+ * @brief API PRIVATE Returns the slot holding key in table or in the table it is migrating from, or NULL.
  *
- * Reference:
- *   * Algorithms in C: Third Edition by Robert Sedgewick, p579
+ * The old table is probed first. Migration publishes a slot in the new table before tombstoning it in the old one, so
+ * a reader that finds the old slot already moved is guaranteed to find it in the new table.
  */
-size_t prom_map_get_index(prom_map_t *self, const char *key) {
-  return prom_map_get_index_internal(key, &self->size, &self->max_size);
-}
-
-static void *prom_map_get_internal(const char *key, size_t *size, size_t *max_size, prom_linked_list_t *keys,
-                                   prom_linked_list_t **addrs, prom_map_node_free_value_fn free_value_fn) {
-  size_t index = prom_map_get_index_internal(key, size, max_size);
-  prom_linked_list_t *list = addrs[index];
-  prom_map_node_t *temp_map_node = prom_map_node_new(key, NULL, free_value_fn);
-
-  for (prom_linked_list_node_t *current_node = list->head; current_node != NULL; current_node = current_node->next) {
-    prom_map_node_t *current_map_node = (prom_map_node_t *)current_node->item;
-    prom_linked_list_compare_t result = prom_linked_list_compare(list, current_map_node, temp_map_node);
-    if (result == PROM_EQUAL) {
-      prom_map_node_destroy(temp_map_node);
-      temp_map_node = NULL;
-      return current_map_node->value;
-    }
+static prom_map_node_t *prom_map_lookup_internal(prom_map_table_t *table, const char *key, size_t len, uint64_t hash,
+                                                 prom_map_entry_t **entry_out) {
+  prom_map_table_t *from = atomic_load_explicit(&table->from, memory_order_acquire);
+  if (from != NULL) {
+    prom_map_node_t *node = prom_map_find_internal(from, key, len, hash, entry_out);
+    if (node != NULL) return node;
   }
-  prom_map_node_destroy(temp_map_node);
-  temp_map_node = NULL;
-  return NULL;
+  return prom_map_find_internal(table, key, len, hash, entry_out);
 }
 
-void *prom_map_get(prom_map_t *self, const char *key) {
+/**
+ * @brief API PRIVATE Returns the empty slot at the end of the probe sequence for hash. Only writers call this.
+ */
+static prom_map_node_t *prom_map_place_internal(prom_map_table_t *table, uint64_t hash) {
+  size_t mask = table->max_size - 1;
+  size_t i = hash & mask;
+  while (atomic_load_explicit(&table->nodes[i].entry, memory_order_relaxed) != NULL) i = (i + 1) & mask;
+  return &table->nodes[i];
+}
+
+/**
+ * @brief API PRIVATE Fills an empty slot. The entry is stored last so a reader that sees it also sees the hash.
+ */
+static void prom_map_publish_internal(prom_map_node_t *node, prom_map_entry_t *entry) {
+  node->hash = entry->hash;
+  atomic_store_explicit(&node->entry, entry, memory_order_release);
+}
+
+void *prom_map_get_hashed(prom_map_t *self, const char *key, size_t len, uint64_t hash) {
   PROM_ASSERT(self != NULL);
-  int r = 0;
-  r = pthread_rwlock_wrlock(self->rwlock);
-  if (r) {
-    PROM_LOG(PROM_PTHREAD_RWLOCK_LOCK_ERROR);
-    NULL;
-  }
-  void *payload =
-      prom_map_get_internal(key, &self->size, &self->max_size, self->keys, self->addrs, self->free_value_fn);
-  r = pthread_rwlock_unlock(self->rwlock);
-  if (r) {
-    PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);
-    return NULL;
+  void *payload = NULL;
+  self = prom_map_shard_internal(self, hash);
+
+  prom_epoch_enter();
+  prom_map_table_t *table = atomic_load_explicit(&self->table, memory_order_acquire);
+  prom_map_node_t *node = NULL;
+  prom_map_entry_t *entry = NULL;
+  for (;;) {
+    node = prom_map_lookup_internal(table, key, len, hash, &entry);
+    if (node != NULL) break;
+    // A resize may have started after table was loaded and already moved the key out of it. Moves happen only after
+    // the new table is installed, so retrying until the current table is stable cannot miss a key.
+    prom_map_table_t *current = atomic_load_explicit(&self->table, memory_order_acquire);
+    if (current == table) break;
+    table = current;
   }
+  if (node != NULL) payload = atomic_load_explicit(&entry->value, memory_order_acquire);
+  prom_epoch_exit();
+
   return payload;
 }
 
-static int prom_map_set_internal(const char *key, void *value, size_t *size, size_t *max_size, prom_linked_list_t *keys,
-                                 prom_linked_list_t **addrs, prom_map_node_free_value_fn free_value_fn,
-                                 bool destroy_current_value) {
-  prom_map_node_t *map_node = prom_map_node_new(key, value, free_value_fn);
-  if (map_node == NULL) return 1;
-
-  size_t index = prom_map_get_index_internal(key, size, max_size);
-  prom_linked_list_t *list = addrs[index];
-  for (prom_linked_list_node_t *current_node = list->head; current_node != NULL; current_node = current_node->next) {
-    prom_map_node_t *current_map_node = (prom_map_node_t *)current_node->item;
-    prom_linked_list_compare_t result = prom_linked_list_compare(list, current_map_node, map_node);
-    if (result == PROM_EQUAL) {
-      if (destroy_current_value) {
-        free_value_fn(current_map_node->value);
-        current_map_node->value = NULL;
-      }
-      prom_free((char *)current_map_node->key);
-      current_map_node->key = NULL;
-      prom_free(current_map_node);
-      current_map_node = NULL;
-      current_node->item = map_node;
-      return 0;
-    }
+void *prom_map_get(prom_map_t *self, const char *key) {
+  size_t len = strlen(key);
+  return prom_map_get_hashed(self, key, len, prom_map_hash(key, len));
+}
+
+/**
+ * @brief API PRIVATE Copies the live entries of the order array into a new array of the given capacity.
+ *
+ * This both grows the array and squeezes out the holes left by deletes. Each entry's index is updated to its new
+ * position, and the old array is retired since cursors may still be walking it.
+ */
+static int prom_map_order_rebuild_internal(prom_map_t *self, size_t capacity) {
+  prom_map_order_t *order = atomic_load_explicit(&self->order, memory_order_relaxed);
+  prom_map_order_t *new_order = prom_map_order_new(capacity);
+  if (new_order == NULL) return 1;
+
+  size_t count = atomic_load_explicit(&order->count, memory_order_relaxed);
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    prom_map_entry_t *entry = atomic_load_explicit(&order->entries[i], memory_order_relaxed);
+    if (entry == NULL) continue;
+    entry->index = n;
+    atomic_init(&new_order->entries[n++], entry);
   }
-  prom_linked_list_append(list, map_node);
-  prom_linked_list_append(keys, (char *)map_node->key);
-  (*size)++;
-  return 0;
+  atomic_init(&new_order->count, n);
+
+  atomic_store_explicit(&self->order, new_order, memory_order_release);
+  return prom_epoch_retire(&self->garbage, order, prom_map_order_free);
 }
 
-int prom_map_ensure_space(prom_map_t *self) {
-  PROM_ASSERT(self != NULL);
+/**
+ * @brief API PRIVATE Appends entry to the order array, growing it first if it is full.
+ */
+static int prom_map_order_append_internal(prom_map_t *self, prom_map_entry_t *entry) {
   int r = 0;
+  prom_map_order_t *order = atomic_load_explicit(&self->order, memory_order_relaxed);
+  size_t count = atomic_load_explicit(&order->count, memory_order_relaxed);
+  if (count == order->capacity) {
+    // Size the new array from the live entries so a map that churns does not grow without bound
+    size_t capacity = PROM_MAP_INITIAL_ORDER_SIZE;
+    while (capacity <= self->size) capacity *= 2;
+    r = prom_map_order_rebuild_internal(self, capacity * 2);
+    if (r) return r;
+    order = atomic_load_explicit(&self->order, memory_order_relaxed);
+    count = atomic_load_explicit(&order->count, memory_order_relaxed);
+  }
+
+  entry->index = count;
+  atomic_store_explicit(&order->entries[count], entry, memory_order_relaxed);
+  atomic_store_explicit(&order->count, count + 1, memory_order_release);
+  return 0;
+}
 
-  if (self->size <= self->max_size / 2) {
+static int prom_map_set_internal(prom_map_t *self, const char *key, size_t len, uint64_t hash, void *value) {
+  int r = 0;
+  prom_map_table_t *table = atomic_load_explicit(&self->table, memory_order_relaxed);
+  prom_map_entry_t *entry = NULL;
+  prom_map_node_t *node = prom_map_lookup_internal(table, key, len, hash, &entry);
+  if (node != NULL) {
+    // A concurrent reader may still be looking at the value being replaced
+    void *current = atomic_exchange_explicit(&entry->value, value, memory_order_acq_rel);
+    if (current != NULL && current != value) return prom_epoch_retire(&self->garbage, current, self->free_value_fn);
     return 0;
   }
 
-  // Increase the max size
-  size_t new_max = self->max_size * 2;
-  size_t new_size = 0;
-
-  // Create a new list of keys
-  prom_linked_list_t *new_keys = prom_linked_list_new();
-  if (new_keys == NULL) return 1;
+  entry = prom_map_entry_new(len);
+  if (entry == NULL) return 1;
+  entry->hash = hash;
+  entry->len = len;
+  atomic_init(&entry->value, value);
+  memcpy(entry->key, key, len + 1);
 
-  r = prom_linked_list_set_free_fn(new_keys, prom_linked_list_no_op_free);
-  if (r) return r;
+  r = prom_map_order_append_internal(self, entry);
+  if (r) {
+    prom_map_entry_free(entry);
+    return r;
+  }
 
-  // Create a new array of addrs
-  prom_linked_list_t **new_addrs = prom_malloc(sizeof(prom_linked_list_t) * new_max);
+  prom_map_publish_internal(prom_map_place_internal(table, hash), entry);
+  self->used++;
+  self->size++;
+  return 0;
+}
 
-  // Initialize the new array
-  for (int i = 0; i < new_max; i++) {
-    new_addrs[i] = prom_linked_list_new();
-    r = prom_linked_list_set_free_fn(new_addrs[i], prom_map_node_free);
-    if (r) return r;
-    r = prom_linked_list_set_compare_fn(new_addrs[i], prom_map_node_compare);
-    if (r) return r;
+/**
+ * @brief API PRIVATE Moves up to count slots of the table being migrated from into the current table.
+ *
+ * Each live slot is published in the current table before it is tombstoned in the old one. Only the entry pointer and
+ * its cached hash move, so neither hashing nor allocation happens per entry. Once the old table has been walked it is
+ * detached and retired.
+ */
+static int prom_map_migrate_internal(prom_map_t *self, size_t count) {
+  prom_map_table_t *table = atomic_load_explicit(&self->table, memory_order_relaxed);
+  prom_map_table_t *from = atomic_load_explicit(&table->from, memory_order_relaxed);
+  if (from == NULL) return 0;
+
+  size_t end = count < from->max_size - self->migrate_index ? self->migrate_index + count : from->max_size;
+  for (size_t i = self->migrate_index; i < end; i++) {
+    prom_map_node_t *node = &from->nodes[i];
+    prom_map_entry_t *entry = atomic_load_explicit(&node->entry, memory_order_relaxed);
+    if (!PROM_MAP_ENTRY_IS_LIVE(entry)) continue;
+    prom_map_publish_internal(prom_map_place_internal(table, node->hash), entry);
+    atomic_store_explicit(&node->entry, &prom_map_tombstone, memory_order_release);
+    self->used++;
   }
+  self->migrate_index = end;
+  if (end < from->max_size) return 0;
 
-  // Iterate through each linked-list at each memory region in the map's backbone
-  for (int i = 0; i < self->max_size; i++) {
-    // Create a new map node for each node in the linked list and insert it into the new map. Afterwards, deallocate
-    // the old map node
-    prom_linked_list_t *list = self->addrs[i];
-    prom_linked_list_node_t *current_node = list->head;
-    while (current_node != NULL) {
-      prom_map_node_t *map_node = (prom_map_node_t *)current_node->item;
-      r = prom_map_set_internal(map_node->key, map_node->value, &new_size, &new_max, new_keys, new_addrs,
-                                self->free_value_fn, false);
-      if (r) return r;
-
-      prom_linked_list_node_t *next = current_node->next;
-      prom_free(current_node);
-      current_node = NULL;
-      prom_free((void *)map_node->key);
-      map_node->key = NULL;
-      prom_free(map_node);
-      map_node = NULL;
-      current_node = next;
-    }
-    // We're done deallocating each map node in the linked list, so deallocate the linked-list object
-    prom_free(self->addrs[i]);
-    self->addrs[i] = NULL;
+  atomic_store_explicit(&table->from, NULL, memory_order_release);
+  self->migrate_index = 0;
+  return prom_epoch_retire(&self->garbage, from, prom_map_free_generic);
+}
+
+int prom_map_ensure_space(prom_map_t *self) {
+  PROM_ASSERT(self != NULL);
+  int r = 0;
+
+  // Every write pays for a bounded slice of any migration in progress
+  r = prom_map_migrate_internal(self, PROM_MAP_MIGRATE_STEP);
+  if (r) return r;
+
+  // Tombstones lengthen probe sequences just like live entries, so both count towards the load
+  prom_map_table_t *table = atomic_load_explicit(&self->table, memory_order_relaxed);
+  if (self->used < table->max_size / 2) {
+    return 0;
   }
-  // Destroy the collection of keys in the map
-  prom_linked_list_destroy(self->keys);
-  self->keys = NULL;
 
-  // Deallocate the backbone of the map
-  prom_free(self->addrs);
-  self->addrs = NULL;
+  // A table is never migrated from while it is itself being migrated into
+  r = prom_map_migrate_internal(self, SIZE_MAX);
+  if (r) return r;
 
-  // Update the members of the current map
-  self->size = new_size;
-  self->max_size = new_max;
-  self->keys = new_keys;
-  self->addrs = new_addrs;
+  // Double the table if it is mostly live entries. Otherwise rebuild at the same size to clear the tombstones.
+  size_t new_max = self->size >= table->max_size / 4 ? table->max_size * 2 : table->max_size;
 
-  return 0;
+  prom_map_table_t *new_table = prom_map_table_new(new_max);
+  if (new_table == NULL) return 1;
+
+  // Readers switch to the new table here and fall back to the old one until it is drained
+  atomic_init(&new_table->from, table);
+  atomic_store_explicit(&self->table, new_table, memory_order_release);
+  self->used = 0;
+  self->migrate_index = 0;
+
+  return prom_map_migrate_internal(self, PROM_MAP_MIGRATE_STEP);
 }
 
 int prom_map_set(prom_map_t *self, const char *key, void *value) {
+  PROM_ASSERT(self != NULL);
+  size_t len = strlen(key);
+  return prom_map_set_hashed(self, key, len, prom_map_hash(key, len), value);
+}
+
+int prom_map_set_hashed(prom_map_t *self, const char *key, size_t len, uint64_t hash, void *value) {
   PROM_ASSERT(self != NULL);
   int r = 0;
+  self = prom_map_shard_internal(self, hash);
   r = pthread_rwlock_wrlock(self->rwlock);
   if (r) {
     PROM_LOG(PROM_PTHREAD_RWLOCK_LOCK_ERROR);
@@ -339,8 +607,7 @@ int prom_map_set(prom_map_t *self, const char *key, void *value) {
       return r;
     }
   }
-  r = prom_map_set_internal(key, value, &self->size, &self->max_size, self->keys, self->addrs, self->free_value_fn,
-                            true);
+  r = prom_map_set_internal(self, key, len, hash, value);
   if (r) {
     int rr = 0;
     rr = pthread_rwlock_unlock(self->rwlock);
@@ -351,6 +618,7 @@ int prom_map_set(prom_map_t *self, const char *key, void *value) {
       return r;
     }
   }
+  prom_epoch_collect(&self->garbage);
   r = pthread_rwlock_unlock(self->rwlock);
   if (r) {
     PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);
@@ -358,43 +626,59 @@ int prom_map_set(prom_map_t *self, const char *key, void *value) {
   return r;
 }
 
-static int prom_map_delete_internal(const char *key, size_t *size, size_t *max_size, prom_linked_list_t *keys,
-                                    prom_linked_list_t **addrs, prom_map_node_free_value_fn free_value_fn) {
+static int prom_map_delete_internal(prom_map_t *self, const char *key, size_t len, uint64_t hash) {
   int r = 0;
-  size_t index = prom_map_get_index_internal(key, size, max_size);
-  prom_linked_list_t *list = addrs[index];
-  prom_map_node_t *temp_map_node = prom_map_node_new(key, NULL, free_value_fn);
-
-  for (prom_linked_list_node_t *current_node = list->head; current_node != NULL; current_node = current_node->next) {
-    prom_map_node_t *current_map_node = (prom_map_node_t *)current_node->item;
-    prom_linked_list_compare_t result = prom_linked_list_compare(list, current_map_node, temp_map_node);
-    if (result == PROM_EQUAL) {
-      r = prom_linked_list_remove(list, current_node);
-      if (r) return r;
-
-      r = prom_linked_list_remove(keys, (char *)current_map_node->key);
-      if (r) return r;
-
-      (*size)--;
-      break;
-    }
+  prom_map_table_t *table = atomic_load_explicit(&self->table, memory_order_relaxed);
+  prom_map_entry_t *entry = NULL;
+  prom_map_node_t *node = prom_map_lookup_internal(table, key, len, hash, &entry);
+  if (node == NULL) return 0;
+
+  atomic_store_explicit(&node->entry, &prom_map_tombstone, memory_order_release);
+
+  prom_map_order_t *order = atomic_load_explicit(&self->order, memory_order_relaxed);
+  atomic_store_explicit(&order->entries[entry->index], NULL, memory_order_release);
+  self->size--;
+
+  // A concurrent reader or cursor may still be looking at the entry and its value
+  void *value = atomic_exchange_explicit(&entry->value, NULL, memory_order_acq_rel);
+  if (value != NULL) {
+    r = prom_epoch_retire(&self->garbage, value, self->free_value_fn);
+    if (r) return r;
   }
-  r = prom_map_node_destroy(temp_map_node);
-  temp_map_node = NULL;
-  return r;
+  r = prom_epoch_retire(&self->garbage, entry, prom_map_entry_free);
+  if (r) return r;
+
+  // Squeeze out the holes once they make up half of the order array. This costs O(size) at most once per size deletes.
+  size_t count = atomic_load_explicit(&order->count, memory_order_relaxed);
+  if (count > PROM_MAP_INITIAL_ORDER_SIZE && count - self->size > count / 2) {
+    r = prom_map_order_rebuild_internal(self, order->capacity);
+    if (r) return r;
+  }
+
+  return 0;
 }
 
 int prom_map_delete(prom_map_t *self, const char *key) {
+  PROM_ASSERT(self != NULL);
+  size_t len = strlen(key);
+  return prom_map_delete_hashed(self, key, len, prom_map_hash(key, len));
+}
+
+int prom_map_delete_hashed(prom_map_t *self, const char *key, size_t len, uint64_t hash) {
   PROM_ASSERT(self != NULL);
   int r = 0;
   int ret = 0;
+  self = prom_map_shard_internal(self, hash);
   r = pthread_rwlock_wrlock(self->rwlock);
   if (r) {
     PROM_LOG(PROM_PTHREAD_RWLOCK_LOCK_ERROR);
-    ret = r;
+    return r;
   }
-  r = prom_map_delete_internal(key, &self->size, &self->max_size, self->keys, self->addrs, self->free_value_fn);
+  r = prom_map_delete_internal(self, key, len, hash);
   if (r) ret = r;
+  r = prom_map_migrate_internal(self, PROM_MAP_MIGRATE_STEP);
+  if (r) ret = r;
+  prom_epoch_collect(&self->garbage);
   r = pthread_rwlock_unlock(self->rwlock);
   if (r) {
     PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);
@@ -406,10 +690,55 @@ int prom_map_delete(prom_map_t *self, const char *key) {
 int prom_map_set_free_value_fn(prom_map_t *self, prom_map_node_free_value_fn free_value_fn) {
   PROM_ASSERT(self != NULL);
   self->free_value_fn = free_value_fn;
+  for (size_t i = 0; i < self->shard_count; i++) self->shards[i]->free_value_fn = free_value_fn;
   return 0;
 }
 
+void prom_map_cursor_begin(prom_map_t *self, prom_map_cursor_t *cursor) {
+  PROM_ASSERT(self != NULL);
+  PROM_ASSERT(cursor != NULL);
+  prom_epoch_enter();
+  cursor->map = self;
+  cursor->shard = 0;
+  cursor->order = atomic_load_explicit(&(self->shards != NULL ? self->shards[0] : self)->order, memory_order_acquire);
+  cursor->index = 0;
+}
+
+bool prom_map_cursor_next(prom_map_cursor_t *cursor, const char **key, void **value) {
+  PROM_ASSERT(cursor != NULL);
+  for (;;) {
+    size_t count = atomic_load_explicit(&cursor->order->count, memory_order_acquire);
+    while (cursor->index < count) {
+      prom_map_entry_t *entry = atomic_load_explicit(&cursor->order->entries[cursor->index++], memory_order_acquire);
+      if (entry == NULL) continue;
+      void *payload = atomic_load_explicit(&entry->value, memory_order_acquire);
+      if (payload == NULL) continue;
+      if (key != NULL) *key = entry->key;
+      if (value != NULL) *value = payload;
+      return true;
+    }
+
+    // Shards are walked one after the other
+    if (cursor->shard + 1 >= cursor->map->shard_count) return false;
+    cursor->shard++;
+    cursor->order = atomic_load_explicit(&cursor->map->shards[cursor->shard]->order, memory_order_acquire);
+    cursor->index = 0;
+  }
+}
+
+void prom_map_cursor_end(prom_map_cursor_t *cursor) {
+  PROM_ASSERT(cursor != NULL);
+  cursor->map = NULL;
+  cursor->order = NULL;
+  prom_epoch_exit();
+}
+
 size_t prom_map_size(prom_map_t *self) {
   PROM_ASSERT(self != NULL);
-  return self->size;
+  if (self->shards == NULL) return self->size;
+
+  // Each shard's size is only updated under that shard's lock, so the total is a best-effort snapshot
+  size_t size = 0;
+  for (size_t i = 0; i < self->shard_count; i++) size += self->shards[i]->size;
+  return size;
 }
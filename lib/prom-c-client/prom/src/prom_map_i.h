@@ -17,22 +17,84 @@
 #ifndef PROM_MAP_I_INCLUDED
 #define PROM_MAP_I_INCLUDED
 
+#include <stdbool.h>
+
 #include "prom_map_t.h"
 
 prom_map_t *prom_map_new(void);
 
+/**
+ * @brief API PRIVATE Returns a map whose keys are spread over shard_count independently locked shards. shard_count is
+ * rounded up to a power of two, and a count of 0 or 1 yields a plain map.
+ *
+ * Iteration visits the shards one after the other, so entries come out in insertion order only within a shard.
+ */
+prom_map_t *prom_map_new_sharded(size_t shard_count);
+
 int prom_map_set_free_value_fn(prom_map_t *self, prom_map_node_free_value_fn free_value_fn);
 
 void *prom_map_get(prom_map_t *self, const char *key);
 
+/**
+ * @brief API PRIVATE Seeds prom_map_hash. prom_map_new does this, so only code that hashes before creating a map needs
+ * to call it.
+ */
+void prom_map_hash_init(void);
+
+/**
+ * @brief API PRIVATE Returns the hash prom_map uses for the first len bytes of key
+ */
+uint64_t prom_map_hash(const char *key, size_t len);
+
+/**
+ * @brief API PRIVATE Same as prom_map_get for callers that already know the length of key and its hash as returned by
+ * prom_map_hash. This neither locks nor allocates.
+ */
+void *prom_map_get_hashed(prom_map_t *self, const char *key, size_t len, uint64_t hash);
+
 int prom_map_set(prom_map_t *self, const char *key, void *value);
 
+/**
+ * @brief API PRIVATE Same as prom_map_set for callers that already know the length of key and its hash as returned by
+ * prom_map_hash.
+ *
+ * The first len bytes of key are the key and may contain NUL bytes, but key[len] MUST be NUL. Such keys are only
+ * found again by prom_map_get_hashed.
+ */
+int prom_map_set_hashed(prom_map_t *self, const char *key, size_t len, uint64_t hash, void *value);
+
+/**
+ * @brief API PRIVATE Removes key from the map. Its value is freed once no reader can reference it any more.
+ */
 int prom_map_delete(prom_map_t *self, const char *key);
 
+/**
+ * @brief API PRIVATE Same as prom_map_delete for keys set with prom_map_set_hashed
+ */
+int prom_map_delete_hashed(prom_map_t *self, const char *key, size_t len, uint64_t hash);
+
 int prom_map_destroy(prom_map_t *self);
 
-size_t prom_map_size(prom_map_t *self);
+/**
+ * @brief API PRIVATE Starts walking the entries of self in insertion order.
+ *
+ * Iteration takes no lock and holds an epoch read-side section until prom_map_cursor_end, so the cursor MUST be ended
+ * on every path. Entries inserted or deleted concurrently may or may not be seen.
+ */
+void prom_map_cursor_begin(prom_map_t *self, prom_map_cursor_t *cursor);
 
-prom_map_node_t *prom_map_node_new(const char *key, void *value, prom_map_node_free_value_fn free_value_fn);
+/**
+ * @brief API PRIVATE Advances cursor to the next entry. Returns false once there are no more entries.
+ *
+ * key and value may be NULL if the caller does not need them. The key remains valid until prom_map_cursor_end.
+ */
+bool prom_map_cursor_next(prom_map_cursor_t *cursor, const char **key, void **value);
+
+/**
+ * @brief API PRIVATE Finishes a walk started by prom_map_cursor_begin.
+ */
+void prom_map_cursor_end(prom_map_cursor_t *cursor);
+
+size_t prom_map_size(prom_map_t *self);
 
 #endif  // PROM_MAP_I_INCLUDED
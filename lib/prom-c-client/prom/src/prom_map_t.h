@@ -18,28 +18,102 @@
 #define PROM_MAP_T_H
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
 // Public
 #include "prom_map.h"
 
 // Private
-#include "prom_linked_list_t.h"
+#include "prom_epoch_t.h"
 
 typedef void (*prom_map_node_free_value_fn)(void *);
 
+/**
+ * @brief API PRIVATE A key/value pair stored in a prom_map. The key is stored inline after the struct.
+ *
+ * Entries never move once inserted, so readers can hold on to one for the length of an epoch read-side section. A
+ * deleted entry is retired through the map's garbage list rather than freed immediately.
+ */
+typedef struct prom_map_entry {
+  size_t index;          /**< position of this entry in the map's order array */
+  uint64_t hash;         /**< hash of key */
+  size_t len;            /**< length of key, excluding the terminating NUL */
+  _Atomic(void *) value; /**< value stored for key, NULL once deleted */
+  char key[];            /**< NUL-terminated key */
+} prom_map_entry_t;
+
+/**
+ * @brief API PRIVATE A slot in the open-addressing table of a prom_map.
+ *
+ * A slot is empty when entry is NULL and deleted when entry points at the map's tombstone marker. The full hash of the
+ * key is cached so probes can reject most mismatches without touching the entry and so resizes never rehash strings.
+ *
+ * Readers do not lock, so a slot is published by storing its entry last. A slot never goes back to empty and a
+ * tombstone is never reused within the same table; both only disappear when the table is replaced.
+ */
 struct prom_map_node {
-  const char *key;
-  void *value;
-  prom_map_node_free_value_fn free_value_fn;
+  uint64_t hash;                     /**< hash of the entry's key */
+  _Atomic(prom_map_entry_t *) entry; /**< NULL, the tombstone marker or an entry owned by the map */
 };
 
+/**
+ * @brief API PRIVATE The slots of a prom_map.
+ *
+ * When the map is resized a new table is installed with from pointing at the old one. Live slots are then moved over a
+ * few at a time by later writes, and from is cleared once the old table is empty.
+ */
+typedef struct prom_map_table {
+  size_t max_size;                       /**< the number of slots. This is always a power of two */
+  _Atomic(struct prom_map_table *) from; /**< the table still being migrated into this one, or NULL */
+  prom_map_node_t nodes[];               /**< Flat array of max_size slots probed linearly from the hash of a key */
+} prom_map_table_t;
+
+/**
+ * @brief API PRIVATE The entries of a prom_map in insertion order.
+ *
+ * Entries are appended at count. Deleting an entry leaves a NULL hole behind, and the holes are squeezed out by
+ * copying the live entries into a fresh array once they make up half of it. Replaced arrays are retired, so a cursor
+ * may keep walking the array it started on.
+ */
+typedef struct prom_map_order {
+  size_t capacity;                        /**< the number of entries that fit */
+  _Atomic size_t count;                   /**< the number of entries appended, including holes */
+  _Atomic(prom_map_entry_t *) entries[];  /**< entries in insertion order, NULL where one was deleted */
+} prom_map_order_t;
+
+/**
+ * @brief API PRIVATE A hash map keyed by strings.
+ *
+ * Lookups and iteration take no lock. They run inside an epoch read-side section so that tables, order arrays and
+ * entries unlinked by a concurrent writer are not freed underneath them. Inserts, deletes and resizes are serialized by
+ * rwlock.
+ *
+ * A sharded map holds no entries itself. It routes each key to one of shard_count independent maps, each with its own
+ * rwlock, so that writers working on different keys rarely wait on each other.
+ */
 struct prom_map {
-  size_t size;                /**< contains the size of the map */
-  size_t max_size;            /**< stores the current max_size */
-  prom_linked_list_t *keys;   /**< linked list containing containing all keys present */
-  prom_linked_list_t **addrs; /**< Sequence of linked lists. Each list contains nodes with the same index */
-  pthread_rwlock_t *rwlock;
+  size_t size;                       /**< contains the size of the map */
+  size_t used;                       /**< count of live slots plus tombstones in the current table */
+  _Atomic(prom_map_table_t *) table; /**< the current table */
+  size_t migrate_index;              /**< the next slot of table->from to migrate */
+  _Atomic(prom_map_order_t *) order; /**< the entries in insertion order */
+  prom_epoch_garbage_t garbage;      /**< tables, order arrays and entries unlinked by writers, awaiting reclamation */
+  pthread_rwlock_t *rwlock;          /**< serializes writers */
   prom_map_node_free_value_fn free_value_fn;
+  struct prom_map **shards;          /**< the shards of a sharded map, otherwise NULL */
+  size_t shard_count;                /**< the number of shards. This is always a power of two */
+  unsigned shard_shift;              /**< shift that turns a hash into a shard index */
 };
 
+/**
+ * @brief API PRIVATE Walks the entries of a prom_map in insertion order. See prom_map_cursor_begin.
+ */
+typedef struct prom_map_cursor {
+  prom_map_t *map;         /**< the map being walked */
+  size_t shard;            /**< the shard of map being walked, if it is sharded */
+  prom_map_order_t *order; /**< the order array being walked */
+  size_t index;            /**< the next position in order to look at */
+} prom_map_cursor_t;
+
 #endif  // PROM_MAP_T_H
@@ -15,6 +15,7 @@
  */
 
 #include <pthread.h>
+#include <stdatomic.h>
 
 // Public
 #include "prom_alloc.h"
@@ -22,27 +23,110 @@
 
 // Private
 #include "prom_assert.h"
+#include "prom_epoch_i.h"
 #include "prom_errors.h"
+#include "prom_histogram_sparse_i.h"
+#include "prom_intern_i.h"
 #include "prom_log.h"
 #include "prom_map_i.h"
-#include "prom_metric_formatter_i.h"
 #include "prom_metric_i.h"
 #include "prom_metric_sample_histogram_i.h"
 #include "prom_metric_sample_i.h"
+#include "prom_metric_sample_summary_i.h"
+#include "prom_sweeper_i.h"
 
 char *prom_metric_type_map[4] = {"counter", "gauge", "histogram", "summary"};
 
+prom_counter_t *prom_series_overflow_updates_total = NULL;
+
+static pthread_once_t prom_metric_limit_once = PTHREAD_ONCE_INIT;
+
+static void prom_metric_limit_init_once(void) {
+  const char *help = "Updates that went to the overflow series because their label set would have exceeded the series "
+                     "limit of their metric.";
+  prom_series_overflow_updates_total =
+      prom_counter_new("prom_series_overflow_updates_total", help, 1, (const char *[]){"metric"});
+}
+
+int prom_metric_limit_init(void) {
+  pthread_once(&prom_metric_limit_once, &prom_metric_limit_init_once);
+  return prom_series_overflow_updates_total == NULL;
+}
+
+/**
+ * @brief API PRIVATE Returns an empty map for the samples of a metric of the given type
+ */
+static prom_map_t *prom_metric_samples_new(prom_metric_type_t metric_type, size_t shard_count) {
+  int r = 0;
+  prom_map_t *samples = prom_map_new_sharded(shard_count);
+  if (samples == NULL) return NULL;
+
+  if (metric_type == PROM_HISTOGRAM) {
+    r = prom_map_set_free_value_fn(samples, &prom_metric_sample_histogram_free_generic);
+  } else if (metric_type == PROM_SUMMARY) {
+    r = prom_map_set_free_value_fn(samples, &prom_metric_sample_summary_free_generic);
+  } else {
+    r = prom_map_set_free_value_fn(samples, &prom_metric_sample_free_generic);
+  }
+  if (r) {
+    prom_map_destroy(samples);
+    return NULL;
+  }
+  return samples;
+}
+
 prom_metric_t *prom_metric_new(prom_metric_type_t metric_type, const char *name, const char *help,
                                size_t label_key_count, const char **label_keys) {
   int r = 0;
   prom_metric_t *self = (prom_metric_t *)prom_malloc(sizeof(prom_metric_t));
+  if (self == NULL) return NULL;
   self->type = metric_type;
   self->name = name;
   self->help = help;
   self->buckets = NULL;
+  self->sparse = NULL;
+  self->quantiles = NULL;
+  self->quantile_count = 0;
+  self->max_age_ms = 0;
+  self->age_bucket_count = 0;
+  self->allocator = prom_allocator_default();
+  self->unlabeled = NULL;
+  atomic_init(&self->unlabeled_used, false);
+  self->cell_count = 0;
+  self->ttl_ms = 0;
+  atomic_init(&self->max_series, 0);
+  atomic_init(&self->series_count, 0);
+  self->overflow = NULL;
+  atomic_init(&self->overflow_used, false);
+  self->value_fn = NULL;
+  self->value_ctx = NULL;
+  self->samples = NULL;
+  self->label_keys = NULL;
+  self->label_key_count = 0;
+
+  // Everything prom_metric_destroy tears down is set up before the first step that can fail
+  self->rwlock = (pthread_rwlock_t *)prom_malloc(sizeof(pthread_rwlock_t));
+  if (self->rwlock == NULL) {
+    prom_free(self);
+    return NULL;
+  }
+  r = pthread_rwlock_init(self->rwlock, NULL);
+  if (r) {
+    PROM_LOG(PROM_PTHREAD_RWLOCK_INIT_ERROR);
+    prom_free(self->rwlock);
+    prom_free(self);
+    return NULL;
+  }
 
-  const char **k = (const char **)prom_malloc(sizeof(const char *) * label_key_count);
+  if (label_key_count > 0) {
+    self->label_keys = (const char **)prom_malloc(sizeof(const char *) * label_key_count);
+    if (self->label_keys == NULL) {
+      prom_metric_destroy(self);
+      return NULL;
+    }
+  }
 
+  // label_key_count only counts the keys interned so far, so that a failure releases exactly those
   for (int i = 0; i < label_key_count; i++) {
     if (strcmp(label_keys[i], "le") == 0) {
       PROM_LOG(PROM_METRIC_INVALID_LABEL_NAME);
@@ -54,40 +138,43 @@ prom_metric_t *prom_metric_new(prom_metric_type_t metric_type, const char *name,
       prom_metric_destroy(self);
       return NULL;
     }
-    k[i] = prom_strdup(label_keys[i]);
-  }
-  self->label_keys = k;
-  self->label_key_count = label_key_count;
-  self->samples = prom_map_new();
-
-  if (metric_type == PROM_HISTOGRAM) {
-    r = prom_map_set_free_value_fn(self->samples, &prom_metric_sample_histogram_free_generic);
-    if (r) {
-      prom_metric_destroy(self);
-      return NULL;
-    }
-  } else {
-    r = prom_map_set_free_value_fn(self->samples, &prom_metric_sample_free_generic);
-    if (r) {
+    self->label_keys[i] = prom_intern(label_keys[i]);
+    if (self->label_keys[i] == NULL) {
       prom_metric_destroy(self);
       return NULL;
     }
+    self->label_key_count++;
   }
-
-  self->formatter = prom_metric_formatter_new();
-  if (self->formatter == NULL) {
+  self->samples = prom_metric_samples_new(metric_type, 1);
+  if (self->samples == NULL) {
     prom_metric_destroy(self);
     return NULL;
   }
-  self->rwlock = (pthread_rwlock_t *)prom_malloc(sizeof(pthread_rwlock_t));
-  r = pthread_rwlock_init(self->rwlock, NULL);
-  if (r) {
-    PROM_LOG(PROM_PTHREAD_RWLOCK_INIT_ERROR);
-    return NULL;
+
+  // A counter or gauge without labels has exactly one sample, so it is kept out of the samples map and updates to it
+  // skip formatting, hashing and locking altogether
+  if (label_key_count == 0 && metric_type != PROM_HISTOGRAM && metric_type != PROM_SUMMARY) {
+    self->unlabeled = prom_metric_sample_new(metric_type, 0.0, 0, prom_allocator_default());
+    if (self->unlabeled == NULL) {
+      prom_metric_destroy(self);
+      return NULL;
+    }
   }
   return self;
 }
 
+prom_metric_t *prom_metric_new_func(prom_metric_type_t metric_type, const char *name, const char *help,
+                                    prom_metric_value_fn fn, void *ctx) {
+  PROM_ASSERT(fn != NULL);
+  if (fn == NULL) return NULL;
+
+  prom_metric_t *self = prom_metric_new(metric_type, name, help, 0, NULL);
+  if (self == NULL) return NULL;
+  self->value_fn = fn;
+  self->value_ctx = ctx;
+  return self;
+}
+
 int prom_metric_destroy(prom_metric_t *self) {
   PROM_ASSERT(self != NULL);
   if (self == NULL) return 0;
@@ -95,19 +182,51 @@ int prom_metric_destroy(prom_metric_t *self) {
   int r = 0;
   int ret = 0;
 
+  // Once this returns, the sweeper is done with the metric
+  if (self->ttl_ms != 0) {
+    r = prom_sweeper_set_ttl(self, 0);
+    if (r) ret = r;
+  }
+
+  // Histogram and summary samples refer to the buckets, the sparse layout or the quantiles until they are gone
+  if (self->samples != NULL) {
+    r = prom_map_destroy(self->samples);
+    self->samples = NULL;
+    if (r) ret = r;
+  }
+
+  if (self->overflow != NULL && self->type == PROM_HISTOGRAM) {
+    r = prom_metric_sample_histogram_destroy((prom_metric_sample_histogram_t *)self->overflow);
+    if (r) ret = r;
+  } else if (self->overflow != NULL && self->type == PROM_SUMMARY) {
+    r = prom_metric_sample_summary_destroy((prom_metric_sample_summary_t *)self->overflow);
+    if (r) ret = r;
+  } else if (self->overflow != NULL) {
+    r = prom_metric_sample_destroy((prom_metric_sample_t *)self->overflow);
+    if (r) ret = r;
+  }
+  self->overflow = NULL;
+
   if (self->buckets != NULL) {
     r = prom_histogram_buckets_destroy(self->buckets);
     self->buckets = NULL;
     if (r) ret = r;
   }
 
-  r = prom_map_destroy(self->samples);
-  self->samples = NULL;
-  if (r) ret = r;
+  if (self->sparse != NULL) {
+    r = prom_histogram_sparse_destroy(self->sparse);
+    self->sparse = NULL;
+    if (r) ret = r;
+  }
 
-  r = prom_metric_formatter_destroy(self->formatter);
-  self->formatter = NULL;
-  if (r) ret = r;
+  prom_free(self->quantiles);
+  self->quantiles = NULL;
+
+  if (self->unlabeled != NULL) {
+    r = prom_metric_sample_destroy(self->unlabeled);
+    self->unlabeled = NULL;
+    if (r) ret = r;
+  }
 
   r = pthread_rwlock_destroy(self->rwlock);
   if (r) {
@@ -119,10 +238,10 @@ int prom_metric_destroy(prom_metric_t *self) {
   self->rwlock = NULL;
 
   for (int i = 0; i < self->label_key_count; i++) {
-    prom_free((void *)self->label_keys[i]);
+    prom_intern_release(self->label_keys[i]);
     self->label_keys[i] = NULL;
   }
-  prom_free(self->label_keys);
+  prom_allocator_free(self->allocator, self->label_keys);
   self->label_keys = NULL;
 
   prom_free(self);
@@ -144,95 +263,556 @@ void prom_metric_free_generic(void *item) {
   prom_metric_destroy(self);
 }
 
-prom_metric_sample_t *prom_metric_sample_from_labels(prom_metric_t *self, const char **label_values) {
+int prom_metric_set_allocator(prom_metric_t *self, const prom_allocator_t *allocator) {
   PROM_ASSERT(self != NULL);
+  if (self == NULL) return 1;
+  if (self->allocator == allocator) return 0;
+
   int r = 0;
   r = pthread_rwlock_wrlock(self->rwlock);
   if (r) {
     PROM_LOG(PROM_PTHREAD_RWLOCK_LOCK_ERROR);
-    return NULL;
+    return r;
+  }
+
+  // Move the label key array over, if there is one. The keys themselves are interned and stay where they are.
+  if (self->label_key_count > 0) {
+    const char **label_keys =
+        (const char **)prom_allocator_malloc(allocator, sizeof(const char *) * self->label_key_count);
+    if (label_keys == NULL) {
+      pthread_rwlock_unlock(self->rwlock);
+      return 1;
+    }
+    memcpy(label_keys, self->label_keys, sizeof(const char *) * self->label_key_count);
+    prom_allocator_free(self->allocator, self->label_keys);
+    self->label_keys = label_keys;
+  }
+  self->allocator = allocator;
+
+  r = pthread_rwlock_unlock(self->rwlock);
+  if (r) PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);
+  return r;
+}
+
+int prom_metric_set_sample_shards(prom_metric_t *self, size_t shard_count) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 1;
+
+  if (prom_map_size(self->samples) != 0) {
+    PROM_LOG(PROM_METRIC_SAMPLES_EXIST);
+    return 1;
+  }
+
+  prom_map_t *samples = prom_metric_samples_new(self->type, shard_count);
+  if (samples == NULL) return 1;
+
+  prom_map_t *old_samples = self->samples;
+  self->samples = samples;
+  return prom_map_destroy(old_samples);
+}
+
+int prom_metric_set_sample_cells(prom_metric_t *self, size_t cell_count) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 1;
+
+  if (self->type == PROM_GAUGE || self->type == PROM_SUMMARY) {
+    PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
+    return 1;
+  }
+  if (prom_map_size(self->samples) != 0 || atomic_load(&self->unlabeled_used)) {
+    PROM_LOG(PROM_METRIC_SAMPLES_EXIST);
+    return 1;
+  }
+
+  if (self->unlabeled != NULL) {
+    prom_metric_sample_t *unlabeled = prom_metric_sample_new(self->type, 0.0, cell_count, prom_allocator_default());
+    if (unlabeled == NULL) return 1;
+    prom_metric_sample_destroy(self->unlabeled);
+    self->unlabeled = unlabeled;
+  }
+  self->cell_count = cell_count;
+  return 0;
+}
+
+// The number of updates of a metric resolved at a time
+#define PROM_METRIC_UPDATE_CHUNK_SIZE 32
+
+// Series keys up to this long are built on the stack when looking up a sample
+#define PROM_METRIC_SERIES_KEY_BUF_SIZE 256
+
+/**
+ * @brief API PRIVATE Writes the series key of label_values into buf and returns its length. Nothing is written if the
+ * key and its terminating NUL do not fit into size bytes.
+ *
+ * A series key is each label value followed by a NUL, so it holds just what tells the series of a metric apart. The
+ * metric name and label keys are the same for every series and are only added when the series is exposed.
+ */
+static size_t prom_metric_series_key(char *buf, size_t size, size_t label_count, const char **label_values) {
+  size_t len = 0;
+  for (size_t i = 0; i < label_count; i++) len += strlen(label_values[i]) + 1;
+  if (len + 1 > size) return len;
+
+  char *p = buf;
+  for (size_t i = 0; i < label_count; i++) {
+    size_t value_len = strlen(label_values[i]) + 1;
+    memcpy(p, label_values[i], value_len);
+    p += value_len;
+  }
+  *p = '\0';
+  return len;
+}
+
+/**
+ * @brief API PRIVATE Builds the series key of label_values in buf, which MUST hold PROM_METRIC_SERIES_KEY_BUF_SIZE
+ * bytes, or on the heap if it does not fit. Returns the key, which MUST be freed with prom_free if it is not buf.
+ */
+static char *prom_metric_series_key_load(prom_metric_t *self, const char **label_values, char *buf, size_t *len) {
+  *len = prom_metric_series_key(buf, PROM_METRIC_SERIES_KEY_BUF_SIZE, self->label_key_count, label_values);
+  if (*len < PROM_METRIC_SERIES_KEY_BUF_SIZE) return buf;
+
+  char *key = (char *)prom_malloc(*len + 1);
+  if (key == NULL) return NULL;
+  prom_metric_series_key(key, *len + 1, self->label_key_count, label_values);
+  return key;
+}
+
+/**
+ * @brief API PRIVATE Returns the length of series_key, a key of the metric's samples map
+ */
+static size_t prom_metric_series_key_len(prom_metric_t *self, const char *series_key) {
+  size_t len = 0;
+  for (size_t i = 0; i < self->label_key_count; i++) len += strlen(series_key + len) + 1;
+  return len;
+}
+
+void prom_metric_series_label_values(prom_metric_t *self, const char *series_key, const char **label_values) {
+  PROM_ASSERT(self != NULL);
+  for (size_t i = 0; i < self->label_key_count; i++) {
+    label_values[i] = series_key;
+    series_key += strlen(series_key) + 1;
+  }
+}
+
+/**
+ * @brief API PRIVATE Creates a sample for a new series of the metric. The result is a prom_metric_sample_histogram_t*
+ * for histograms, a prom_metric_sample_summary_t* for summaries and a prom_metric_sample_t* otherwise.
+ */
+static void *prom_metric_sample_new_internal(prom_metric_t *self) {
+  if (self->type == PROM_HISTOGRAM) {
+    return prom_metric_sample_histogram_new(self->buckets, self->sparse, self->cell_count);
+  }
+  if (self->type == PROM_SUMMARY) {
+    return prom_metric_sample_summary_new(self->quantiles, self->quantile_count, self->max_age_ms,
+                                          self->age_bucket_count);
+  }
+  return prom_metric_sample_new(self->type, 0.0, self->cell_count, self->allocator);
+}
+
+static void prom_metric_sample_destroy_internal(prom_metric_t *self, void *sample) {
+  if (self->type == PROM_HISTOGRAM) {
+    prom_metric_sample_histogram_destroy((prom_metric_sample_histogram_t *)sample);
+  } else if (self->type == PROM_SUMMARY) {
+    prom_metric_sample_summary_destroy((prom_metric_sample_summary_t *)sample);
+  } else {
+    prom_metric_sample_destroy((prom_metric_sample_t *)sample);
+  }
+}
+
+/**
+ * @brief API PRIVATE Looks the series of label_values up in the metric's samples map without taking any lock.
+ *
+ * The sweeper may evict the series of a metric with a TTL at any time, so the caller MUST be in a read-side section
+ * for as long as it uses the result. Returns NULL for a series that does not exist yet.
+ */
+static void *prom_metric_sample_lookup_internal(prom_metric_t *self, const char **label_values) {
+  char buf[PROM_METRIC_SERIES_KEY_BUF_SIZE];
+  size_t len = 0;
+  char *key = prom_metric_series_key_load(self, label_values, buf, &len);
+  if (key == NULL) return NULL;
+
+  void *sample = prom_map_get_hashed(self->samples, key, len, prom_map_hash(key, len));
+  if (key != buf) prom_free(key);
+  return sample;
+}
+
+/**
+ * @brief API PRIVATE Returns whether the metric holds as many series as it may. Only the insert path checks this, so
+ * updates of existing series never pay for the limit.
+ */
+static bool prom_metric_series_full_internal(prom_metric_t *self) {
+  size_t max_series = atomic_load_explicit(&self->max_series, memory_order_acquire);
+  return max_series != 0 && atomic_load_explicit(&self->series_count, memory_order_relaxed) >= max_series;
+}
+
+/**
+ * @brief API PRIVATE Returns the overflow sample for a label set that would exceed the metric's series limit, and
+ * counts the update that goes to it
+ */
+static void *prom_metric_sample_overflow_internal(prom_metric_t *self) {
+  if (!atomic_load_explicit(&self->overflow_used, memory_order_relaxed)) {
+    atomic_store_explicit(&self->overflow_used, true, memory_order_release);
+  }
+  prom_counter_inc(prom_series_overflow_updates_total, (const char *[]){self->name});
+  return self->overflow;
+}
+
+/**
+ * @brief API PRIVATE Returns the sample of the series of label_values, creating the series if it is missing. The caller
+ * MUST hold the metric's rwlock for writing, which makes the lookup and the insertion one step.
+ *
+ * A missing series is only created while the metric is below its series limit. Past it, the overflow sample is
+ * returned instead.
+ */
+static void *prom_metric_sample_create_locked_internal(prom_metric_t *self, const char **label_values) {
+  int r = 0;
+  char buf[PROM_METRIC_SERIES_KEY_BUF_SIZE];
+  size_t len = 0;
+  char *key = prom_metric_series_key_load(self, label_values, buf, &len);
+  if (key == NULL) return NULL;
+
+  uint64_t hash = prom_map_hash(key, len);
+  void *sample = prom_map_get_hashed(self->samples, key, len, hash);
+  if (sample == NULL && prom_metric_series_full_internal(self)) {
+    sample = prom_metric_sample_overflow_internal(self);
+  } else if (sample == NULL) {
+    sample = prom_metric_sample_new_internal(self);
+    if (sample != NULL) {
+      r = prom_map_set_hashed(self->samples, key, len, hash, sample);
+      if (r) {
+        prom_metric_sample_destroy_internal(self, sample);
+        sample = NULL;
+      } else {
+        atomic_fetch_add_explicit(&self->series_count, 1, memory_order_relaxed);
+      }
+    }
+  }
+
+  if (key != buf) prom_free(key);
+  return sample;
+}
+
+int prom_metric_samples_from_labels(prom_metric_t *self, size_t count, const char ***label_values, void **samples) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 1;
+
+  int r = 0;
+  int ret = 0;
+
+  if (self->unlabeled != NULL) {
+    if (!atomic_load_explicit(&self->unlabeled_used, memory_order_relaxed)) {
+      atomic_store_explicit(&self->unlabeled_used, true, memory_order_release);
+    }
+    for (size_t i = 0; i < count; i++) samples[i] = self->unlabeled;
+    return 0;
   }
 
-#define PROM_METRIC_SAMPLE_FROM_LABELS_HANDLE_UNLOCK() \
-  r = pthread_rwlock_unlock(self->rwlock);             \
-  if (r) PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);   \
-  return NULL;
+  // Existing series, which is all a steady-state update ever touches, are found without locking
+  size_t missing = 0;
+  for (size_t i = 0; i < count; i++) {
+    samples[i] = prom_metric_sample_lookup_internal(self, label_values[i]);
+    if (samples[i] == NULL) missing++;
+  }
+  if (missing == 0) return 0;
+
+  // A metric at its series limit has nothing to create, so a flood of new label sets does not serialize on the lock
+  if (prom_metric_series_full_internal(self)) {
+    for (size_t i = 0; i < count; i++) {
+      if (samples[i] == NULL) samples[i] = prom_metric_sample_overflow_internal(self);
+    }
+    return 0;
+  }
+
+  // The rest are created under one acquisition of the lock. Each one is looked up again first, so that racing
+  // threads create a series only once.
+  r = pthread_rwlock_wrlock(self->rwlock);
+  if (r) {
+    PROM_LOG(PROM_PTHREAD_RWLOCK_LOCK_ERROR);
+    return r;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (samples[i] != NULL) continue;
+    samples[i] = prom_metric_sample_create_locked_internal(self, label_values[i]);
+    if (samples[i] == NULL) ret = 1;
+  }
+  r = pthread_rwlock_unlock(self->rwlock);
+  if (r) {
+    PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);
+    ret = r;
+  }
+  return ret;
+}
+
+/**
+ * @brief API PRIVATE Returns the state the sweeper keeps for the series of sample
+ */
+static prom_metric_sample_state_t *prom_metric_sample_state_internal(prom_metric_t *self, void *sample) {
+  if (self->type == PROM_HISTOGRAM) return &((prom_metric_sample_histogram_t *)sample)->state;
+  if (self->type == PROM_SUMMARY) return &((prom_metric_sample_summary_t *)sample)->state;
+  return &((prom_metric_sample_t *)sample)->state;
+}
+
+/**
+ * @brief API PRIVATE Returns the sample of the series of label_values, creating the series if it is missing or has
+ * been evicted. Returns NULL upon failure.
+ *
+ * The sweeper holds the metric's rwlock while it evicts, so taking it here also waits for an eviction to be over. A
+ * series the sweeper decided to keep after all is returned as is.
+ */
+static void *prom_metric_sample_create_internal(prom_metric_t *self, const char **label_values) {
+  int r = 0;
+  if (prom_metric_series_full_internal(self)) return prom_metric_sample_overflow_internal(self);
 
-  // Get l_value
-  r = prom_metric_formatter_load_l_value(self->formatter, self->name, NULL, self->label_key_count, self->label_keys,
-                                         label_values);
+  r = pthread_rwlock_wrlock(self->rwlock);
   if (r) {
-    PROM_METRIC_SAMPLE_FROM_LABELS_HANDLE_UNLOCK();
+    PROM_LOG(PROM_PTHREAD_RWLOCK_LOCK_ERROR);
+    return NULL;
   }
+  void *sample = prom_metric_sample_create_locked_internal(self, label_values);
+  r = pthread_rwlock_unlock(self->rwlock);
+  if (r) PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);
+  return sample;
+}
 
-  // This must be freed before returning
-  const char *l_value = prom_metric_formatter_dump(self->formatter);
-  if (l_value == NULL) {
-    PROM_METRIC_SAMPLE_FROM_LABELS_HANDLE_UNLOCK();
+/**
+ * @brief API PRIVATE Applies update to sample, the sample of its series
+ */
+static int prom_metric_apply_internal(prom_metric_t *self, const prom_batch_update_t *update, void *sample) {
+  switch (update->op) {
+    case PROM_BATCH_SET:
+      if (self->type != PROM_GAUGE) break;
+      return prom_metric_sample_set((prom_metric_sample_t *)sample, update->value);
+    case PROM_BATCH_ADD:
+      if (self->type != PROM_GAUGE && self->type != PROM_COUNTER) break;
+      return prom_metric_sample_add((prom_metric_sample_t *)sample, update->value);
+    case PROM_BATCH_SUB:
+      if (self->type != PROM_GAUGE) break;
+      return prom_metric_sample_sub((prom_metric_sample_t *)sample, update->value);
+    case PROM_BATCH_OBSERVE:
+      if (self->type == PROM_SUMMARY) {
+        return prom_metric_sample_summary_observe((prom_metric_sample_summary_t *)sample, update->value);
+      }
+      if (self->type != PROM_HISTOGRAM) break;
+      return prom_metric_sample_histogram_observe((prom_metric_sample_histogram_t *)sample, update->value);
   }
+  PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
+  return 1;
+}
 
-  // Get sample
-  prom_metric_sample_t *sample = (prom_metric_sample_t *)prom_map_get(self->samples, l_value);
+/**
+ * @brief API PRIVATE Applies a single update to a labeled metric. This is the path of every prom_counter_inc,
+ * prom_gauge_set and prom_histogram_observe.
+ *
+ * The series key is built before entering the read-side section, which keeps the section, and the barrier that
+ * opens it, down to the lookup and the update itself.
+ */
+static int prom_metric_update_one_internal(prom_metric_t *self, const prom_batch_update_t *update) {
+  int r = 0;
+  char buf[PROM_METRIC_SERIES_KEY_BUF_SIZE];
+  size_t len = 0;
+  char *key = prom_metric_series_key_load(self, update->label_values, buf, &len);
+  if (key == NULL) return 1;
+  uint64_t hash = prom_map_hash(key, len);
+
+  prom_epoch_enter();
+  void *sample = prom_map_get_hashed(self->samples, key, len, hash);
+  if (key != buf) prom_free(key);
+  if (sample == NULL) sample = prom_metric_sample_create_internal(self, update->label_values);
   if (sample == NULL) {
-    sample = prom_metric_sample_new(self->type, l_value, 0.0);
-    r = prom_map_set(self->samples, l_value, sample);
-    if (r) {
-      PROM_METRIC_SAMPLE_FROM_LABELS_HANDLE_UNLOCK();
+    prom_epoch_exit();
+    return 1;
+  }
+
+  prom_metric_sample_state_t *state = prom_metric_sample_state_internal(self, sample);
+  prom_sweeper_touch(state);
+  r = prom_metric_apply_internal(self, update, sample);
+
+  // An update that raced with the eviction of its series went to a sample that is gone, so it is applied again to
+  // the series that replaces it
+  if (atomic_load(&state->evicted)) {
+    void *revived = prom_metric_sample_create_internal(self, update->label_values);
+    if (revived == NULL) {
+      r = 1;
+    } else if (revived != sample) {
+      prom_sweeper_touch(prom_metric_sample_state_internal(self, revived));
+      r = prom_metric_apply_internal(self, update, revived);
+    }
+  }
+  prom_epoch_exit();
+  return r;
+}
+
+int prom_metric_update(prom_metric_t *self, size_t count, const prom_batch_update_t *updates) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 1;
+
+  int r = 0;
+  int ret = 0;
+
+  if (self->unlabeled != NULL) {
+    if (!atomic_load_explicit(&self->unlabeled_used, memory_order_relaxed)) {
+      atomic_store_explicit(&self->unlabeled_used, true, memory_order_release);
+    }
+    for (size_t i = 0; i < count; i++) {
+      r = prom_metric_apply_internal(self, &updates[i], self->unlabeled);
+      if (r) ret = r;
+    }
+    return ret;
+  }
+
+  if (count == 1) return prom_metric_update_one_internal(self, updates);
+
+  const char **label_values[PROM_METRIC_UPDATE_CHUNK_SIZE];
+  void *samples[PROM_METRIC_UPDATE_CHUNK_SIZE];
+
+  // The sweeper may evict a series at any time. Staying in a read-side section keeps the samples alive until the
+  // updates are done with them.
+  prom_epoch_enter();
+  for (size_t i = 0; i < count; i += PROM_METRIC_UPDATE_CHUNK_SIZE) {
+    size_t n = count - i < PROM_METRIC_UPDATE_CHUNK_SIZE ? count - i : PROM_METRIC_UPDATE_CHUNK_SIZE;
+    for (size_t j = 0; j < n; j++) label_values[j] = updates[i + j].label_values;
+
+    r = prom_metric_samples_from_labels(self, n, label_values, samples);
+    if (r) ret = r;
+
+    for (size_t j = 0; j < n; j++) {
+      if (samples[j] == NULL) continue;
+      prom_metric_sample_state_t *state = prom_metric_sample_state_internal(self, samples[j]);
+      prom_sweeper_touch(state);
+      r = prom_metric_apply_internal(self, &updates[i + j], samples[j]);
+      if (r) ret = r;
+
+      // An update that raced with the eviction of its series went to a sample that is gone, so it is applied again to
+      // the series that replaces it
+      if (!atomic_load(&state->evicted)) continue;
+      void *revived = prom_metric_sample_create_internal(self, label_values[j]);
+      if (revived == NULL) {
+        ret = 1;
+      } else if (revived != samples[j]) {
+        prom_sweeper_touch(prom_metric_sample_state_internal(self, revived));
+        r = prom_metric_apply_internal(self, &updates[i + j], revived);
+        if (r) ret = r;
+      }
+    }
+  }
+  prom_epoch_exit();
+  return ret;
+}
+
+/**
+ * @brief API PRIVATE Returns the sample of the series of label_values and pins the series, so that the sweeper never
+ * evicts it. The sample is handed out to the user, who may keep it for as long as the metric lives.
+ */
+static void *prom_metric_sample_pin_internal(prom_metric_t *self, const char **label_values) {
+  void *sample = NULL;
+  prom_epoch_enter();
+  prom_metric_samples_from_labels(self, 1, &label_values, &sample);
+  if (sample != NULL) {
+    prom_metric_sample_state_t *state = prom_metric_sample_state_internal(self, sample);
+    atomic_store(&state->pinned, true);
+    if (atomic_load(&state->evicted)) {
+      sample = prom_metric_sample_create_internal(self, label_values);
+      if (sample != NULL) atomic_store(&prom_metric_sample_state_internal(self, sample)->pinned, true);
     }
   }
-  pthread_rwlock_unlock(self->rwlock);
-  prom_free((void *)l_value);
+  prom_epoch_exit();
   return sample;
 }
 
+prom_metric_sample_t *prom_metric_sample_from_labels(prom_metric_t *self, const char **label_values) {
+  PROM_ASSERT(self != NULL);
+  return (prom_metric_sample_t *)prom_metric_sample_pin_internal(self, label_values);
+}
+
 prom_metric_sample_histogram_t *prom_metric_sample_histogram_from_labels(prom_metric_t *self,
                                                                          const char **label_values) {
   PROM_ASSERT(self != NULL);
+  return (prom_metric_sample_histogram_t *)prom_metric_sample_pin_internal(self, label_values);
+}
+
+prom_metric_sample_summary_t *prom_metric_sample_summary_from_labels(prom_metric_t *self, const char **label_values) {
+  PROM_ASSERT(self != NULL);
+  return (prom_metric_sample_summary_t *)prom_metric_sample_pin_internal(self, label_values);
+}
 
+size_t prom_metric_evict_stale_series(prom_metric_t *self, uint64_t now) {
+  PROM_ASSERT(self != NULL);
   int r = 0;
+  size_t evicted = 0;
+  if (self->ttl_ms == 0) return 0;
+
   r = pthread_rwlock_wrlock(self->rwlock);
   if (r) {
     PROM_LOG(PROM_PTHREAD_RWLOCK_LOCK_ERROR);
-    return NULL;
+    return 0;
   }
 
-#define PROM_METRIC_SAMPLE_HISTOGRAM_FROM_LABELS_HANDLE_UNLOCK() \
-  r = pthread_rwlock_unlock(self->rwlock);                       \
-  if (r) {                                                       \
-    PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);                  \
-    return NULL;                                                 \
+  prom_map_cursor_t cursor;
+  const char *key = NULL;
+  void *sample = NULL;
+  prom_map_cursor_begin(self->samples, &cursor);
+  while (prom_map_cursor_next(&cursor, &key, &sample)) {
+    prom_metric_sample_state_t *state = prom_metric_sample_state_internal(self, sample);
+    if (atomic_load_explicit(&state->pinned, memory_order_relaxed)) continue;
+    if (now - atomic_load_explicit(&state->touched, memory_order_relaxed) <= self->ttl_ms) continue;
+
+    // Announce the eviction and look again. A writer that touched the series in the meantime either is seen here, and
+    // the series stays, or sees evicted itself and redoes its update on a new series once this one is gone.
+    atomic_store(&state->evicted, true);
+    if (now - atomic_load(&state->touched) <= self->ttl_ms || atomic_load(&state->pinned)) {
+      atomic_store(&state->evicted, false);
+      continue;
+    }
+
+    size_t len = prom_metric_series_key_len(self, key);
+    r = prom_map_delete_hashed(self->samples, key, len, prom_map_hash(key, len));
+    if (r) break;
+    atomic_fetch_sub_explicit(&self->series_count, 1, memory_order_relaxed);
+    evicted++;
   }
+  prom_map_cursor_end(&cursor);
+
+  r = pthread_rwlock_unlock(self->rwlock);
+  if (r) PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);
+  return evicted;
+}
 
-  // Load the l_value
-  r = prom_metric_formatter_load_l_value(self->formatter, self->name, NULL, self->label_key_count, self->label_keys,
-                                         label_values);
+int prom_metric_set_series_ttl(prom_metric_t *self, double ttl) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL || !(ttl >= 0)) return 1;
+  return prom_sweeper_set_ttl(self, (uint64_t)(ttl * 1000));
+}
+
+int prom_metric_set_max_series(prom_metric_t *self, size_t max_series) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 1;
+
+  int r = 0;
+
+  r = prom_metric_limit_init();
+  if (r) return r;
+
+  r = pthread_rwlock_wrlock(self->rwlock);
   if (r) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_FROM_LABELS_HANDLE_UNLOCK();
+    PROM_LOG(PROM_PTHREAD_RWLOCK_LOCK_ERROR);
+    return r;
   }
 
-  // This must be freed before returning
-  const char *l_value = prom_metric_formatter_dump(self->formatter);
-  if (l_value == NULL) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_FROM_LABELS_HANDLE_UNLOCK();
+  // The overflow sample is never evicted and lives as long as the metric, so it is published once, before the limit
+  // that leads updates to it
+  if (max_series != 0 && self->overflow == NULL) {
+    self->overflow = prom_metric_sample_new_internal(self);
+    if (self->overflow == NULL) {
+      r = 1;
+    } else {
+      atomic_store(&prom_metric_sample_state_internal(self, self->overflow)->pinned, true);
+    }
   }
+  if (r == 0) atomic_store_explicit(&self->max_series, max_series, memory_order_release);
 
-  // Get sample
-  prom_metric_sample_histogram_t *sample = (prom_metric_sample_histogram_t *)prom_map_get(self->samples, l_value);
-  if (sample == NULL) {
-    sample = prom_metric_sample_histogram_new(self->name, self->buckets, self->label_key_count, self->label_keys,
-                                              label_values);
-    if (sample == NULL) {
-      prom_free((void *)l_value);
-      PROM_METRIC_SAMPLE_HISTOGRAM_FROM_LABELS_HANDLE_UNLOCK();
-    }
-    r = prom_map_set(self->samples, l_value, sample);
-    if (r) {
-      prom_free((void *)l_value);
-      pthread_rwlock_unlock(self->rwlock);
-      PROM_METRIC_SAMPLE_HISTOGRAM_FROM_LABELS_HANDLE_UNLOCK();
-    }
+  int ret = pthread_rwlock_unlock(self->rwlock);
+  if (ret) {
+    PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);
+    r = ret;
   }
-  pthread_rwlock_unlock(self->rwlock);
-  prom_free((void *)l_value);
-  return sample;
+  return r;
 }
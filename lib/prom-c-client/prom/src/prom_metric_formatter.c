@@ -14,18 +14,23 @@
  * limitations under the License.
  */
 
+#include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 
 // Public
 #include "prom_alloc.h"
+#include "prom_histogram.h"
 
 // Private
 #include "prom_assert.h"
 #include "prom_collector_t.h"
-#include "prom_linked_list_t.h"
 #include "prom_map_i.h"
 #include "prom_metric_formatter_i.h"
-#include "prom_metric_sample_histogram_t.h"
+#include "prom_metric_i.h"
+#include "prom_metric_sample_histogram_i.h"
+#include "prom_metric_sample_i.h"
+#include "prom_metric_sample_summary_i.h"
 #include "prom_metric_sample_t.h"
 #include "prom_metric_t.h"
 #include "prom_string_builder_i.h"
@@ -158,26 +163,191 @@ int prom_metric_formatter_load_l_value(prom_metric_formatter_t *self, const char
   return 0;
 }
 
-int prom_metric_formatter_load_sample(prom_metric_formatter_t *self, prom_metric_sample_t *sample) {
+/**
+ * @brief API PRIVATE Loads the current value of sample and ends the line. The l_value MUST have been loaded already.
+ */
+static int prom_metric_formatter_load_r_value(prom_metric_formatter_t *self, prom_metric_sample_t *sample) {
+  int r = 0;
+
+  r = prom_string_builder_add_char(self->string_builder, ' ');
+  if (r) return r;
+
+  char buffer[50];
+  r = prom_metric_sample_format_value(sample, buffer, sizeof(buffer));
+  if (r) return r;
+
+  r = prom_string_builder_add_str(self->string_builder, buffer);
+  if (r) return r;
+
+  return prom_string_builder_add_char(self->string_builder, '\n');
+}
+
+int prom_metric_formatter_load_sample(prom_metric_formatter_t *self, const char *l_value,
+                                      prom_metric_sample_t *sample) {
   PROM_ASSERT(self != NULL);
   if (self == NULL) return 1;
 
   int r = 0;
 
-  r = prom_string_builder_add_str(self->string_builder, sample->l_value);
+  r = prom_string_builder_add_str(self->string_builder, l_value);
+  if (r) return r;
+
+  return prom_metric_formatter_load_r_value(self, sample);
+}
+
+/**
+ * @brief API PRIVATE Loads the only sample of a callback metric with the value its function computes now. A metric
+ * whose function fails is left without a sample for this scrape.
+ */
+static int prom_metric_formatter_load_callback(prom_metric_formatter_t *self, prom_metric_t *metric) {
+  int r = 0;
+  double value = 0.0;
+  if (metric->value_fn(metric->value_ctx, &value)) return 0;
+
+  char buffer[50];
+  r = snprintf(buffer, sizeof(buffer), "%.17g", value);
+  if (r < 0 || (size_t)r >= sizeof(buffer)) return 1;
+
+  r = prom_string_builder_add_str(self->string_builder, metric->name);
   if (r) return r;
 
   r = prom_string_builder_add_char(self->string_builder, ' ');
   if (r) return r;
 
-  char buffer[50];
-  sprintf(buffer, "%.17g", sample->r_value);
   r = prom_string_builder_add_str(self->string_builder, buffer);
   if (r) return r;
 
   return prom_string_builder_add_char(self->string_builder, '\n');
 }
 
+/**
+ * @brief API PRIVATE Loads the l_value of the series with the given labels followed by the value of sample
+ */
+static int prom_metric_formatter_load_series(prom_metric_formatter_t *self, const char *name, const char *suffix,
+                                             size_t label_count, const char **label_keys, const char **label_values,
+                                             prom_metric_sample_t *sample) {
+  int r = 0;
+
+  r = prom_metric_formatter_load_l_value(self, name, suffix, label_count, label_keys, label_values);
+  if (r) return r;
+
+  return prom_metric_formatter_load_r_value(self, sample);
+}
+
+/**
+ * @brief API PRIVATE Loads the l_value of the series with the given labels followed by value, already formatted
+ */
+static int prom_metric_formatter_load_formatted(prom_metric_formatter_t *self, const char *name, const char *suffix,
+                                                size_t label_count, const char **label_keys,
+                                                const char **label_values, const char *value) {
+  int r = 0;
+
+  r = prom_metric_formatter_load_l_value(self, name, suffix, label_count, label_keys, label_values);
+  if (r) return r;
+
+  r = prom_string_builder_add_char(self->string_builder, ' ');
+  if (r) return r;
+
+  r = prom_string_builder_add_str(self->string_builder, value);
+  if (r) return r;
+
+  return prom_string_builder_add_char(self->string_builder, '\n');
+}
+
+/**
+ * @brief API PRIVATE Loads every sample of a histogram series. label_keys and label_values MUST have room for the le
+ * label after the label_count labels of the series.
+ */
+static int prom_metric_formatter_load_histogram(prom_metric_formatter_t *self, const char *name, size_t label_count,
+                                                const char **label_keys, const char **label_values,
+                                                prom_metric_sample_histogram_t *hist_sample) {
+  int r = 0;
+  char le[50];
+  char value[50];
+
+  // Buckets are stored on their own, so each le value is the running total of the buckets up to it, and the total of
+  // all of them, the one above every bound included, is both le="+Inf" and the count
+  label_keys[label_count] = "le";
+  label_values[label_count] = le;
+  uint64_t cumulative = 0;
+  size_t bucket_count = 0;
+  // A sparse histogram is exposed as the classic buckets of its text layout, whose counts are gathered at once
+  uint64_t sparse_counts[PROM_HISTOGRAM_SPARSE_TEXT_BUCKETS_MAX + 1];
+  prom_histogram_sparse_t *sparse = hist_sample->sparse;
+  if (sparse != NULL) {
+    bucket_count = sparse->text_count;
+    prom_metric_sample_histogram_sparse_counts(hist_sample, sparse_counts);
+  } else {
+    bucket_count = prom_histogram_buckets_count(hist_sample->buckets);
+  }
+  for (size_t i = 0; i < bucket_count; i++) {
+    if (sparse != NULL) {
+      r = prom_metric_sample_histogram_format_bound(sparse->text_bounds[i], le, sizeof(le));
+    } else {
+      r = prom_metric_sample_histogram_format_bucket(hist_sample->buckets->upper_bounds[i], le, sizeof(le));
+    }
+    if (r) return r;
+
+    cumulative += sparse != NULL ? sparse_counts[i] : prom_metric_sample_histogram_bucket(hist_sample, i);
+    snprintf(value, sizeof(value), "%" PRIu64, cumulative);
+    r = prom_metric_formatter_load_formatted(self, name, NULL, label_count + 1, label_keys, label_values, value);
+    if (r) return r;
+  }
+
+  cumulative +=
+      sparse != NULL ? sparse_counts[bucket_count] : prom_metric_sample_histogram_bucket(hist_sample, bucket_count);
+  snprintf(value, sizeof(value), "%" PRIu64, cumulative);
+  label_values[label_count] = "+Inf";
+  r = prom_metric_formatter_load_formatted(self, name, NULL, label_count + 1, label_keys, label_values, value);
+  if (r) return r;
+
+  r = prom_metric_formatter_load_formatted(self, name, "count", label_count, label_keys, label_values, value);
+  if (r) return r;
+
+  snprintf(value, sizeof(value), "%.17g", prom_metric_sample_histogram_sum(hist_sample));
+  return prom_metric_formatter_load_formatted(self, name, "sum", label_count, label_keys, label_values, value);
+}
+
+static int prom_metric_formatter_load_summary(prom_metric_formatter_t *self, const char *name, size_t label_count,
+                                              const char **label_keys, const char **label_values,
+                                              prom_metric_sample_summary_t *summary_sample) {
+  int r = 0;
+  char quantile[50];
+  char value[50];
+  uint64_t count = 0;
+  double sum = 0.0;
+
+  double *estimates = (double *)prom_malloc(sizeof(double) * summary_sample->quantile_count);
+  if (estimates == NULL) return 1;
+  r = prom_metric_sample_summary_load(summary_sample, estimates, &count, &sum);
+  if (r) {
+    prom_free(estimates);
+    return r;
+  }
+
+  label_keys[label_count] = "quantile";
+  label_values[label_count] = quantile;
+  for (size_t i = 0; i < summary_sample->quantile_count; i++) {
+    snprintf(quantile, sizeof(quantile), "%g", summary_sample->quantiles[i]);
+    if (isnan(estimates[i])) {
+      snprintf(value, sizeof(value), "NaN");
+    } else {
+      snprintf(value, sizeof(value), "%.17g", estimates[i]);
+    }
+    r = prom_metric_formatter_load_formatted(self, name, NULL, label_count + 1, label_keys, label_values, value);
+    if (r) break;
+  }
+  prom_free(estimates);
+  if (r) return r;
+
+  snprintf(value, sizeof(value), "%.17g", sum);
+  r = prom_metric_formatter_load_formatted(self, name, "sum", label_count, label_keys, label_values, value);
+  if (r) return r;
+
+  snprintf(value, sizeof(value), "%" PRIu64, count);
+  return prom_metric_formatter_load_formatted(self, name, "count", label_count, label_keys, label_values, value);
+}
+
 int prom_metric_formatter_clear(prom_metric_formatter_t *self) {
   PROM_ASSERT(self != NULL);
   return prom_string_builder_clear(self->string_builder);
@@ -209,53 +379,90 @@ int prom_metric_formatter_load_metric(prom_metric_formatter_t *self, prom_metric
   r = prom_metric_formatter_load_type(self, metric->name, metric->type);
   if (r) return r;
 
-  for (prom_linked_list_node_t *current_node = metric->samples->keys->head; current_node != NULL;
-       current_node = current_node->next) {
-    const char *key = (const char *)current_node->item;
+  // The l_value of a sample without labels is the bare metric name
+  if (metric->value_fn != NULL) {
+    r = prom_metric_formatter_load_callback(self, metric);
+    if (r) return r;
+  } else if (metric->unlabeled != NULL && atomic_load_explicit(&metric->unlabeled_used, memory_order_acquire)) {
+    r = prom_metric_formatter_load_sample(self, metric->name, metric->unlabeled);
+    if (r) return r;
+  }
+
+  // Series are keyed by their label values alone, so each l_value is rendered here from the metric's label keys. One
+  // extra slot is left for the le label of histogram buckets and the quantile label of summaries.
+  size_t label_count = metric->label_key_count;
+  const char **label_keys = (const char **)prom_malloc(sizeof(const char *) * (label_count + 1));
+  const char **label_values = (const char **)prom_malloc(sizeof(const char *) * (label_count + 1));
+  if (label_keys == NULL || label_values == NULL) {
+    prom_free(label_keys);
+    prom_free(label_values);
+    return 1;
+  }
+  for (size_t i = 0; i < label_count; i++) label_keys[i] = metric->label_keys[i];
+
+  prom_map_cursor_t cursor;
+  const char *key = NULL;
+  void *value = NULL;
+  prom_map_cursor_begin(metric->samples, &cursor);
+  while (r == 0 && prom_map_cursor_next(&cursor, &key, &value)) {
+    prom_metric_series_label_values(metric, key, label_values);
+    if (metric->type == PROM_HISTOGRAM) {
+      r = prom_metric_formatter_load_histogram(self, metric->name, label_count, label_keys, label_values,
+                                               (prom_metric_sample_histogram_t *)value);
+    } else if (metric->type == PROM_SUMMARY) {
+      r = prom_metric_formatter_load_summary(self, metric->name, label_count, label_keys, label_values,
+                                             (prom_metric_sample_summary_t *)value);
+    } else {
+      r = prom_metric_formatter_load_series(self, metric->name, NULL, label_count, label_keys, label_values,
+                                            (prom_metric_sample_t *)value);
+    }
+  }
+  prom_map_cursor_end(&cursor);
+  prom_free(label_keys);
+  prom_free(label_values);
+  if (r) return r;
+
+  // Label sets past the metric's series limit share one series that carries only the overflow label
+  if (metric->overflow != NULL && atomic_load_explicit(&metric->overflow_used, memory_order_acquire)) {
+    const char *overflow_keys[] = {"overflow", NULL};
+    const char *overflow_values[] = {"true", NULL};
     if (metric->type == PROM_HISTOGRAM) {
-      prom_metric_sample_histogram_t *hist_sample =
-          (prom_metric_sample_histogram_t *)prom_map_get(metric->samples, key);
-
-      if (hist_sample == NULL) return 1;
-
-      for (prom_linked_list_node_t *current_hist_node = hist_sample->l_value_list->head; current_hist_node != NULL;
-           current_hist_node = current_hist_node->next) {
-        const char *hist_key = (const char *)current_hist_node->item;
-        prom_metric_sample_t *sample = (prom_metric_sample_t *)prom_map_get(hist_sample->samples, hist_key);
-        if (sample == NULL) return 1;
-        r = prom_metric_formatter_load_sample(self, sample);
-        if (r) return r;
-      }
+      r = prom_metric_formatter_load_histogram(self, metric->name, 1, overflow_keys, overflow_values,
+                                               (prom_metric_sample_histogram_t *)metric->overflow);
+    } else if (metric->type == PROM_SUMMARY) {
+      r = prom_metric_formatter_load_summary(self, metric->name, 1, overflow_keys, overflow_values,
+                                             (prom_metric_sample_summary_t *)metric->overflow);
     } else {
-      prom_metric_sample_t *sample = (prom_metric_sample_t *)prom_map_get(metric->samples, key);
-      if (sample == NULL) return 1;
-      r = prom_metric_formatter_load_sample(self, sample);
-      if (r) return r;
+      r = prom_metric_formatter_load_series(self, metric->name, NULL, 1, overflow_keys, overflow_values,
+                                            (prom_metric_sample_t *)metric->overflow);
     }
+    if (r) return r;
   }
+
   return prom_string_builder_add_char(self->string_builder, '\n');
 }
 
 int prom_metric_formatter_load_metrics(prom_metric_formatter_t *self, prom_map_t *collectors) {
   PROM_ASSERT(self != NULL);
   int r = 0;
-  for (prom_linked_list_node_t *current_node = collectors->keys->head; current_node != NULL;
-       current_node = current_node->next) {
-    const char *collector_name = (const char *)current_node->item;
-    prom_collector_t *collector = (prom_collector_t *)prom_map_get(collectors, collector_name);
-    if (collector == NULL) return 1;
-
-    prom_map_t *metrics = collector->collect_fn(collector);
-    if (metrics == NULL) return 1;
-
-    for (prom_linked_list_node_t *current_node = metrics->keys->head; current_node != NULL;
-         current_node = current_node->next) {
-      const char *metric_name = (const char *)current_node->item;
-      prom_metric_t *metric = (prom_metric_t *)prom_map_get(metrics, metric_name);
-      if (metric == NULL) return 1;
-      r = prom_metric_formatter_load_metric(self, metric);
-      if (r) return r;
+  prom_map_cursor_t collector_cursor;
+  void *collector = NULL;
+  prom_map_cursor_begin(collectors, &collector_cursor);
+  while (r == 0 && prom_map_cursor_next(&collector_cursor, NULL, &collector)) {
+    prom_map_t *metrics = ((prom_collector_t *)collector)->collect_fn((prom_collector_t *)collector);
+    if (metrics == NULL) {
+      r = 1;
+      break;
+    }
+
+    prom_map_cursor_t metric_cursor;
+    void *metric = NULL;
+    prom_map_cursor_begin(metrics, &metric_cursor);
+    while (r == 0 && prom_map_cursor_next(&metric_cursor, NULL, &metric)) {
+      r = prom_metric_formatter_load_metric(self, (prom_metric_t *)metric);
     }
+    prom_map_cursor_end(&metric_cursor);
   }
+  prom_map_cursor_end(&collector_cursor);
   return r;
 }
@@ -57,9 +57,10 @@ int prom_metric_formatter_load_l_value(prom_metric_formatter_t *metric_formatter
                                        size_t label_count, const char **label_keys, const char **label_values);
 
 /**
- * @brief API PRIVATE Loads the formatter with a metric sample
+ * @brief API PRIVATE Loads the formatter with a metric sample whose l_value is l_value
  */
-int prom_metric_formatter_load_sample(prom_metric_formatter_t *metric_formatter, prom_metric_sample_t *sample);
+int prom_metric_formatter_load_sample(prom_metric_formatter_t *metric_formatter, const char *l_value,
+                                      prom_metric_sample_t *sample);
 
 /**
  * @brief API PRIVATE Loads a metric in the string exposition format
@@ -14,19 +14,85 @@
  * limitations under the License.
  */
 
+// Public
+#include "prom_batch.h"
+#include "prom_counter.h"
+
 // Private
 #include "prom_metric_sample_histogram_t.h"
+#include "prom_metric_sample_summary_t.h"
 #include "prom_metric_t.h"
 
 #ifndef PROM_METRIC_I_INCLUDED
 #define PROM_METRIC_I_INCLUDED
 
+/**
+ * @brief API PRIVATE Counts the updates that went to the overflow series of their metric, labeled by the name of the
+ * metric. Every update for a label set past the series limit counts, not just the first one.
+ */
+extern prom_counter_t *prom_series_overflow_updates_total;
+
 /**
  * @brief API PRIVATE Returns a *prom_metric
  */
 prom_metric_t *prom_metric_new(prom_metric_type_t type, const char *name, const char *help, size_t label_key_count,
                                const char **label_keys);
 
+/**
+ * @brief API PRIVATE Returns a *prom_metric without labels whose value is computed by fn each time it is scraped
+ */
+prom_metric_t *prom_metric_new_func(prom_metric_type_t type, const char *name, const char *help,
+                                    prom_metric_value_fn fn, void *ctx);
+
+/**
+ * @brief API PRIVATE Makes allocator the home of the metric's label key array and of samples created from now on.
+ * Samples that already exist keep the allocator they were created with.
+ */
+int prom_metric_set_allocator(prom_metric_t *self, const prom_allocator_t *allocator);
+
+/**
+ * @brief API PRIVATE Points label_values at the label values stored in series_key, a key of the metric's samples map.
+ * label_values MUST have room for the metric's label_key_count values, which stay valid as long as the series does.
+ */
+void prom_metric_series_label_values(prom_metric_t *self, const char *series_key, const char **label_values);
+
+/**
+ * @brief API PRIVATE Resolves the samples of count series of the metric at once, creating those that do not exist yet.
+ *
+ * Existing series are looked up without locking, and all missing ones are created under a single acquisition of the
+ * metric's rwlock. samples[i] is set to the prom_metric_sample_histogram_t* of label_values[i] for a histogram, to its
+ * prom_metric_sample_summary_t* for a summary and to its prom_metric_sample_t* otherwise, or to NULL if it could not
+ * be created.
+ *
+ * @return A non-zero integer value if any sample could not be resolved
+ */
+int prom_metric_samples_from_labels(prom_metric_t *self, size_t count, const char ***label_values, void **samples);
+
+/**
+ * @brief API PRIVATE Applies count updates, which MUST all be updates of self, in order.
+ *
+ * This is the path every update of a metric takes. The samples of the updates are resolved together with
+ * prom_metric_samples_from_labels, and an update that races with the eviction of its series is applied to the series
+ * that replaces it.
+ *
+ * @return A non-zero integer value if any update failed
+ */
+int prom_metric_update(prom_metric_t *self, size_t count, const prom_batch_update_t *updates);
+
+/**
+ * @brief API PRIVATE Evicts every series of the metric that was last touched more than the metric's TTL before now,
+ * except for pinned ones. Called by the sweeper.
+ *
+ * @return The number of series evicted
+ */
+size_t prom_metric_evict_stale_series(prom_metric_t *self, uint64_t now);
+
+/**
+ * @brief API PRIVATE Creates prom_series_overflow_updates_total if it does not exist yet
+ * @return A non-zero integer value upon failure
+ */
+int prom_metric_limit_init(void);
+
 /**
  * @brief API PRIVATE Destroys a *prom_metric
  */
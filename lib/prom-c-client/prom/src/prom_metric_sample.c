@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 
+#include <inttypes.h>
 #include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
 
 // Public
 #include "prom_alloc.h"
@@ -25,21 +28,60 @@
 #include "prom_log.h"
 #include "prom_metric_sample_i.h"
 #include "prom_metric_sample_t.h"
+#include "prom_sweeper_i.h"
 
-prom_metric_sample_t *prom_metric_sample_new(prom_metric_type_t type, const char *l_value, double r_value) {
-  prom_metric_sample_t *self = (prom_metric_sample_t *)prom_malloc(sizeof(prom_metric_sample_t));
+// Hands out cell indexes to threads round-robin
+static _Atomic unsigned prom_metric_sample_next_cell = 0;
+
+__thread unsigned prom_metric_sample_thread_cell = 0;
+
+unsigned prom_metric_sample_cell_assign(void) {
+  unsigned cell = atomic_fetch_add_explicit(&prom_metric_sample_next_cell, 1, memory_order_relaxed) + 1;
+  prom_metric_sample_thread_cell = cell;
+  return cell - 1;
+}
+
+prom_metric_sample_t *prom_metric_sample_new(prom_metric_type_t type, double r_value, size_t cell_count,
+                                             const prom_allocator_t *allocator) {
+  prom_metric_sample_t *self = (prom_metric_sample_t *)prom_allocator_malloc(allocator, sizeof(prom_metric_sample_t));
+  if (self == NULL) return NULL;
   self->type = type;
-  self->l_value = prom_strdup(l_value);
+  self->allocator = allocator;
+  self->cells = NULL;
+  self->cell_mask = 0;
+  self->cells_mem = NULL;
+
+  if (cell_count > 1 && type != PROM_GAUGE) {
+    size_t count = 1;
+    while (count < cell_count) count <<= 1;
+    self->cells_mem = prom_allocator_malloc(allocator, count * sizeof(prom_metric_sample_cell_t) +
+                                                           PROM_METRIC_SAMPLE_CACHE_LINE - 1);
+    if (self->cells_mem == NULL) {
+      prom_allocator_free(allocator, self);
+      return NULL;
+    }
+    uintptr_t aligned = ((uintptr_t)self->cells_mem + PROM_METRIC_SAMPLE_CACHE_LINE - 1) &
+                        ~(uintptr_t)(PROM_METRIC_SAMPLE_CACHE_LINE - 1);
+    self->cells = (prom_metric_sample_cell_t *)aligned;
+    for (size_t i = 0; i < count; i++) {
+      atomic_init(&self->cells[i].count, 0);
+      atomic_init(&self->cells[i].value, 0.0);
+    }
+    self->cell_mask = count - 1;
+  }
   self->r_value = ATOMIC_VAR_INIT(r_value);
+  atomic_init(&self->count, 0);
+  prom_sweeper_state_init(&self->state);
   return self;
 }
 
 int prom_metric_sample_destroy(prom_metric_sample_t *self) {
   PROM_ASSERT(self != NULL);
   if (self == NULL) return 0;
-  prom_free((void *)self->l_value);
-  self->l_value = NULL;
-  prom_free((void *)self);
+  prom_allocator_free(self->allocator, self->cells_mem);
+  self->cells_mem = NULL;
+  self->cells = NULL;
+  prom_allocator_free(self->allocator, (void *)self);
   self = NULL;
   return 0;
 }
@@ -58,20 +100,80 @@ void prom_metric_sample_free_generic(void *gen) {
   prom_metric_sample_destroy(self);
 }
 
+static inline void prom_metric_sample_add_internal(_Atomic double *target, double r_value) {
+  _Atomic double old = atomic_load(target);
+  for (;;) {
+    _Atomic double new = ATOMIC_VAR_INIT(old + r_value);
+    if (atomic_compare_exchange_weak(target, &old, new)) {
+      return;
+    }
+  }
+}
+
+// 2^64, the smallest double that does not fit in a uint64_t
+#define PROM_METRIC_SAMPLE_UINT64_LIMIT 18446744073709551616.0
+
 int prom_metric_sample_add(prom_metric_sample_t *self, double r_value) {
   PROM_ASSERT(self != NULL);
   if (r_value < 0) {
     return 1;
   }
-  _Atomic double old = atomic_load(&self->r_value);
-  for (;;) {
-    _Atomic double new = ATOMIC_VAR_INIT(old + r_value);
-    if (atomic_compare_exchange_weak(&self->r_value, &old, new)) {
-      return 0;
+
+  _Atomic uint64_t *count = &self->count;
+  _Atomic double *value = &self->r_value;
+  if (self->cells != NULL) {
+    prom_metric_sample_cell_t *cell = &self->cells[prom_metric_sample_cell_index() & self->cell_mask];
+    count = &cell->count;
+    value = &cell->value;
+  }
+
+  // Whole numbers, such as counter increments and bucket counts, take the wait-free integer path. Gauges keep their
+  // value in the double alone so that it can be set.
+  if (self->type != PROM_GAUGE && r_value < PROM_METRIC_SAMPLE_UINT64_LIMIT && r_value == (double)(uint64_t)r_value) {
+    atomic_fetch_add_explicit(count, (uint64_t)r_value, memory_order_relaxed);
+  } else {
+    prom_metric_sample_add_internal(value, r_value);
+  }
+  return 0;
+}
+
+/**
+ * @brief API PRIVATE Loads the whole-number and fractional parts of the value of the sample
+ */
+static void prom_metric_sample_load(prom_metric_sample_t *self, uint64_t *count, double *value) {
+  *count = atomic_load_explicit(&self->count, memory_order_relaxed);
+  *value = atomic_load(&self->r_value);
+  if (self->cells != NULL) {
+    for (size_t i = 0; i <= self->cell_mask; i++) {
+      *count += atomic_load_explicit(&self->cells[i].count, memory_order_relaxed);
+      *value += atomic_load_explicit(&self->cells[i].value, memory_order_relaxed);
     }
   }
 }
 
+double prom_metric_sample_value(prom_metric_sample_t *self) {
+  PROM_ASSERT(self != NULL);
+  uint64_t count = 0;
+  double value = 0.0;
+  prom_metric_sample_load(self, &count, &value);
+  return (double)count + value;
+}
+
+int prom_metric_sample_format_value(prom_metric_sample_t *self, char *buf, size_t size) {
+  PROM_ASSERT(self != NULL);
+  uint64_t count = 0;
+  double value = 0.0;
+  prom_metric_sample_load(self, &count, &value);
+
+  int n = 0;
+  if (self->type != PROM_GAUGE && value == 0.0) {
+    n = snprintf(buf, size, "%" PRIu64, count);
+  } else {
+    n = snprintf(buf, size, "%.17g", (double)count + value);
+  }
+  return n < 0 || (size_t)n >= size;
+}
+
 int prom_metric_sample_sub(prom_metric_sample_t *self, double r_value) {
   PROM_ASSERT(self != NULL);
   if (self->type != PROM_GAUGE) {
@@ -14,8 +14,12 @@
  * limitations under the License.
  */
 
+#include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 // Public
 #include "prom_alloc.h"
@@ -24,282 +28,188 @@
 // Private
 #include "prom_assert.h"
 #include "prom_errors.h"
-#include "prom_linked_list_i.h"
+#include "prom_histogram_sparse_i.h"
 #include "prom_log.h"
-#include "prom_map_i.h"
-#include "prom_metric_formatter_i.h"
 #include "prom_metric_sample_histogram_i.h"
 #include "prom_metric_sample_i.h"
+#include "prom_sweeper_i.h"
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Static Declarations
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-static const char *prom_metric_sample_histogram_l_value_for_bucket(prom_metric_sample_histogram_t *self,
-                                                                   const char *name, size_t label_count,
-                                                                   const char **label_keys, const char **label_values,
-                                                                   double bucket);
-
-static const char *prom_metric_sample_histogram_l_value_for_inf(prom_metric_sample_histogram_t *self, const char *name,
-                                                                size_t label_count, const char **label_keys,
-                                                                const char **label_values);
-
-static void prom_metric_sample_histogram_free_str_generic(void *gen);
-
-static int prom_metric_sample_histogram_init_bucket_samples(prom_metric_sample_histogram_t *self, const char *name,
-                                                            size_t label_count, const char **label_keys,
-                                                            const char **label_values);
-
-static int prom_metric_sample_histogram_init_inf(prom_metric_sample_histogram_t *self, const char *name,
-                                                 size_t label_count, const char **label_keys,
-                                                 const char **label_values);
-
-static int prom_metric_sample_histogram_init_count(prom_metric_sample_histogram_t *self, const char *name,
-                                                   size_t label_count, const char **label_keys,
-                                                   const char **label_values);
-
-static int prom_metric_sample_histogram_init_summary(prom_metric_sample_histogram_t *self, const char *name,
-                                                     size_t label_count, const char **label_keys,
-                                                     const char **label_values);
+/**
+ * @brief API PRIVATE Returns the row of counters at index i
+ */
+static inline prom_metric_sample_histogram_row_t *prom_metric_sample_histogram_row(prom_metric_sample_histogram_t *self,
+                                                                                   size_t i) {
+  return (prom_metric_sample_histogram_row_t *)(self->rows + i * self->row_size);
+}
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// End static declarations
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The number of slots of the chunk table of a new sparse histogram series
+#define PROM_METRIC_SAMPLE_HISTOGRAM_INITIAL_SLOTS 4
 
-prom_metric_sample_histogram_t *prom_metric_sample_histogram_new(const char *name, prom_histogram_buckets_t *buckets,
-                                                                 size_t label_count, const char **label_keys,
-                                                                 const char **label_values) {
-  // Capture return codes
-  int r = 0;
+/**
+ * @brief API PRIVATE Returns an empty chunk table with slot_count slots
+ */
+static prom_metric_sample_histogram_chunks_t *prom_metric_sample_histogram_chunks_new(size_t slot_count) {
+  prom_metric_sample_histogram_chunks_t *chunks = (prom_metric_sample_histogram_chunks_t *)prom_malloc(
+      sizeof(prom_metric_sample_histogram_chunks_t) + slot_count * sizeof(prom_metric_sample_histogram_chunk_t *));
+  if (chunks == NULL) return NULL;
+  chunks->mask = slot_count - 1;
+  chunks->prev = NULL;
+  for (size_t i = 0; i < slot_count; i++) atomic_init(&chunks->slots[i], NULL);
+  return chunks;
+}
 
-  // Allocate and set self
-  prom_metric_sample_histogram_t *self =
-      (prom_metric_sample_histogram_t *)prom_malloc(sizeof(prom_metric_sample_histogram_t));
+/**
+ * @brief API PRIVATE Returns the slot of chunks to start probing at for the chunk of the given first bucket
+ */
+static inline size_t prom_metric_sample_histogram_chunk_slot(prom_metric_sample_histogram_chunks_t *chunks,
+                                                             int32_t first, bool negative) {
+  uint64_t key = ((uint64_t)(uint32_t)first << 1) | negative;
+  return (size_t)((key * 0x9E3779B97F4A7C15u) >> 32) & chunks->mask;
+}
 
-  // Allocate and set the l_value_list
-  self->l_value_list = prom_linked_list_new();
-  if (self->l_value_list == NULL) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
+/**
+ * @brief API PRIVATE Returns the chunk of the given first bucket in chunks, or NULL if there is none
+ */
+static prom_metric_sample_histogram_chunk_t *prom_metric_sample_histogram_chunk_find(
+    prom_metric_sample_histogram_chunks_t *chunks, int32_t first, bool negative) {
+  for (size_t i = prom_metric_sample_histogram_chunk_slot(chunks, first, negative);; i = (i + 1) & chunks->mask) {
+    prom_metric_sample_histogram_chunk_t *chunk = atomic_load_explicit(&chunks->slots[i], memory_order_acquire);
+    if (chunk == NULL || (chunk->first == first && chunk->negative == negative)) return chunk;
   }
+}
 
-  // Allocate and set the metric formatter
-  self->metric_formatter = prom_metric_formatter_new();
-  if (self->metric_formatter == NULL) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
-  }
+/**
+ * @brief API PRIVATE Puts chunk into the first empty slot of chunks it probes
+ */
+static void prom_metric_sample_histogram_chunk_insert(prom_metric_sample_histogram_chunks_t *chunks,
+                                                      prom_metric_sample_histogram_chunk_t *chunk) {
+  size_t i = prom_metric_sample_histogram_chunk_slot(chunks, chunk->first, chunk->negative);
+  while (atomic_load_explicit(&chunks->slots[i], memory_order_relaxed) != NULL) i = (i + 1) & chunks->mask;
+  atomic_store_explicit(&chunks->slots[i], chunk, memory_order_release);
+}
 
-  // Store map of l_value/prom_metric_sample_t
-  self->samples = prom_map_new();
-  if (self->samples == NULL) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
+/**
+ * @brief API PRIVATE Returns the chunk of the given first bucket, adding it to the series if it is missing. Returns
+ * NULL upon failure.
+ */
+static prom_metric_sample_histogram_chunk_t *prom_metric_sample_histogram_chunk_add(
+    prom_metric_sample_histogram_t *self, int32_t first, bool negative) {
+  pthread_mutex_lock(&self->chunks_lock);
+  prom_metric_sample_histogram_chunks_t *chunks = atomic_load_explicit(&self->chunks, memory_order_relaxed);
+  prom_metric_sample_histogram_chunk_t *chunk = prom_metric_sample_histogram_chunk_find(chunks, first, negative);
+  if (chunk != NULL) {
+    pthread_mutex_unlock(&self->chunks_lock);
+    return chunk;
   }
 
-  // Set the free value function on the samples map
-  r = prom_map_set_free_value_fn(self->samples, &prom_metric_sample_free_generic);
-  if (r) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
+  // Keep the table at most half full, so that probes stay short and always end on an empty slot
+  if ((self->chunk_count + 1) * 2 > chunks->mask + 1) {
+    prom_metric_sample_histogram_chunks_t *grown = prom_metric_sample_histogram_chunks_new((chunks->mask + 1) * 2);
+    if (grown == NULL) {
+      pthread_mutex_unlock(&self->chunks_lock);
+      return NULL;
+    }
+    for (size_t i = 0; i <= chunks->mask; i++) {
+      prom_metric_sample_histogram_chunk_t *moved = atomic_load_explicit(&chunks->slots[i], memory_order_relaxed);
+      if (moved != NULL) prom_metric_sample_histogram_chunk_insert(grown, moved);
+    }
+    grown->prev = chunks;
+    atomic_store_explicit(&self->chunks, grown, memory_order_release);
+    chunks = grown;
   }
 
-  // Set a map of bucket: l_value
-  self->l_values = prom_map_new();  // Store map of bucket/l_value
-  if (self->l_values == NULL) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
+  chunk = (prom_metric_sample_histogram_chunk_t *)prom_malloc(sizeof(prom_metric_sample_histogram_chunk_t));
+  if (chunk != NULL) {
+    chunk->first = first;
+    chunk->negative = negative;
+    for (size_t i = 0; i < PROM_METRIC_SAMPLE_HISTOGRAM_CHUNK_SIZE; i++) atomic_init(&chunk->counts[i], 0);
+    prom_metric_sample_histogram_chunk_insert(chunks, chunk);
+    self->chunk_count++;
   }
+  pthread_mutex_unlock(&self->chunks_lock);
+  return chunk;
+}
 
-  // Set the free value function for thhe l_values map
-  r = prom_map_set_free_value_fn(self->l_values, prom_metric_sample_histogram_free_str_generic);
-  if (r) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
-  }
+prom_metric_sample_histogram_t *prom_metric_sample_histogram_new(prom_histogram_buckets_t *buckets,
+                                                                 prom_histogram_sparse_t *sparse, size_t cell_count) {
+  prom_metric_sample_histogram_t *self =
+      (prom_metric_sample_histogram_t *)prom_malloc(sizeof(prom_metric_sample_histogram_t));
+  if (self == NULL) return NULL;
 
+  prom_sweeper_state_init(&self->state);
   self->buckets = buckets;
-
-  // Allocate and initialize the lock
-  self->rwlock = (pthread_rwlock_t *)prom_malloc(sizeof(pthread_rwlock_t));
-  r = pthread_rwlock_init(self->rwlock, NULL);
-  if (r) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
-  }
-
-  // Allocate and initialize bucket metric samples
-  r = prom_metric_sample_histogram_init_bucket_samples(self, name, label_count, label_keys, label_values);
-  if (r) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
-  }
-
-  // Allocate and initialize the +Inf metric sample
-  r = prom_metric_sample_histogram_init_inf(self, name, label_count, label_keys, label_values);
-  if (r) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
-  }
-
-  // Allocate and initialize the count metric sample
-  r = prom_metric_sample_histogram_init_count(self, name, label_count, label_keys, label_values);
-  if (r) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
+  self->sparse = sparse;
+  atomic_init(&self->chunks, NULL);
+  self->chunk_count = 0;
+  atomic_init(&self->zero_count, 0);
+  if (sparse != NULL) {
+    // Buckets are chunks rather than rows, so only the sum and the bucket of non-finite observations are in the row
+    prom_metric_sample_histogram_chunks_t *chunks =
+        prom_metric_sample_histogram_chunks_new(PROM_METRIC_SAMPLE_HISTOGRAM_INITIAL_SLOTS);
+    if (chunks == NULL) {
+      prom_free(self);
+      return NULL;
+    }
+    atomic_init(&self->chunks, chunks);
+    pthread_mutex_init(&self->chunks_lock, NULL);
+    cell_count = 0;
   }
 
-  // Add summary sample
-  r = prom_metric_sample_histogram_init_summary(self, name, label_count, label_keys, label_values);
-  if (r) {
-    prom_metric_sample_histogram_destroy(self);
+  size_t row_count = 1;
+  while (row_count < cell_count) row_count <<= 1;
+  size_t bucket_count = sparse != NULL ? 0 : prom_histogram_buckets_count(buckets);
+  size_t row_size = sizeof(prom_metric_sample_histogram_row_t) + (bucket_count + 1) * sizeof(_Atomic uint64_t);
+  row_size = (row_size + PROM_METRIC_SAMPLE_CACHE_LINE - 1) & ~(size_t)(PROM_METRIC_SAMPLE_CACHE_LINE - 1);
+
+  // Every counter of the series lives in this one block. Striped rows are only worth their cache lines when threads
+  // contend, so an unstriped series takes a single row.
+  self->rows_mem = prom_malloc(row_count * row_size + PROM_METRIC_SAMPLE_CACHE_LINE - 1);
+  if (self->rows_mem == NULL) {
+    if (sparse != NULL) {
+      prom_free(atomic_load(&self->chunks));
+      pthread_mutex_destroy(&self->chunks_lock);
+    }
+    prom_free(self);
     return NULL;
   }
-
-  // The value of nodes in this map will be simple prom_metric_sample pointers.
-  r = prom_map_set_free_value_fn(self->samples, &prom_metric_sample_free_generic);
-  if (r) {
-    prom_metric_sample_histogram_destroy(self);
-    return NULL;
+  uintptr_t aligned =
+      ((uintptr_t)self->rows_mem + PROM_METRIC_SAMPLE_CACHE_LINE - 1) & ~(uintptr_t)(PROM_METRIC_SAMPLE_CACHE_LINE - 1);
+  self->rows = (unsigned char *)aligned;
+  self->row_mask = row_count - 1;
+  self->row_size = row_size;
+
+  for (size_t i = 0; i < row_count; i++) {
+    prom_metric_sample_histogram_row_t *row = prom_metric_sample_histogram_row(self, i);
+    atomic_init(&row->sum, 0.0);
+    for (size_t j = 0; j <= bucket_count; j++) atomic_init(&row->buckets[j], 0);
   }
   return self;
 }
 
-static int prom_metric_sample_histogram_init_bucket_samples(prom_metric_sample_histogram_t *self, const char *name,
-                                                            size_t label_count, const char **label_keys,
-                                                            const char **label_values) {
-  PROM_ASSERT(self);
-  int r = 0;
-  int bucket_count = prom_histogram_buckets_count(self->buckets);
-
-  // For each bucket, create an prom_metric_sample_t with an appropriate l_value and default value of 0.0. The
-  // l_value will contain the metric name, user labels, and finally, the le label and bucket value.
-  for (int i = 0; i < bucket_count; i++) {
-    const char *l_value = prom_metric_sample_histogram_l_value_for_bucket(self, name, label_count, label_keys,
-                                                                          label_values, self->buckets->upper_bounds[i]);
-    if (l_value == NULL) return 1;
-
-    r = prom_linked_list_append(self->l_value_list, prom_strdup(l_value));
-    if (r) return r;
-
-    const char *bucket_key = prom_metric_sample_histogram_bucket_to_str(self->buckets->upper_bounds[i]);
-    if (bucket_key == NULL) return 1;
-
-    r = prom_map_set(self->l_values, bucket_key, (char *)l_value);
-    if (r) return r;
-
-    prom_metric_sample_t *sample = prom_metric_sample_new(PROM_HISTOGRAM, l_value, 0.0);
-    if (sample == NULL) return 1;
-
-    r = prom_map_set(self->samples, l_value, sample);
-    if (r) return r;
-
-    prom_free((void *)bucket_key);
-  }
-  return 0;
-}
-
-static int prom_metric_sample_histogram_init_inf(prom_metric_sample_histogram_t *self, const char *name,
-                                                 size_t label_count, const char **label_keys,
-                                                 const char **label_values) {
-  PROM_ASSERT(self != NULL);
-  int r = 0;
-  const char *inf_l_value =
-      prom_metric_sample_histogram_l_value_for_inf(self, name, label_count, label_keys, label_values);
-  if (inf_l_value == NULL) return 1;
-
-  r = prom_linked_list_append(self->l_value_list, prom_strdup(inf_l_value));
-  if (r) return r;
-
-  r = prom_map_set(self->l_values, "+Inf", (char *)inf_l_value);
-  if (r) return r;
-
-  prom_metric_sample_t *inf_sample = prom_metric_sample_new(PROM_HISTOGRAM, (char *)inf_l_value, 0.0);
-  if (inf_sample == NULL) return 1;
-
-  return prom_map_set(self->samples, inf_l_value, inf_sample);
-}
-
-static int prom_metric_sample_histogram_init_count(prom_metric_sample_histogram_t *self, const char *name,
-                                                   size_t label_count, const char **label_keys,
-                                                   const char **label_values) {
-  PROM_ASSERT(self != NULL);
-  int r = 0;
-
-  r = prom_metric_formatter_load_l_value(self->metric_formatter, name, "count", label_count, label_keys, label_values);
-  if (r) return r;
-
-  const char *count_l_value = prom_metric_formatter_dump(self->metric_formatter);
-  if (count_l_value == NULL) return 1;
-
-  r = prom_linked_list_append(self->l_value_list, prom_strdup(count_l_value));
-  if (r) return r;
-
-  r = prom_map_set(self->l_values, "count", (char *)count_l_value);
-  if (r) return r;
-
-  prom_metric_sample_t *count_sample = prom_metric_sample_new(PROM_HISTOGRAM, count_l_value, 0.0);
-  if (count_sample == NULL) return 1;
-
-  return prom_map_set(self->samples, count_l_value, count_sample);
-}
-
-static int prom_metric_sample_histogram_init_summary(prom_metric_sample_histogram_t *self, const char *name,
-                                                     size_t label_count, const char **label_keys,
-                                                     const char **label_values) {
-  PROM_ASSERT(self != NULL);
-  int r = 0;
-
-  r = prom_metric_formatter_load_l_value(self->metric_formatter, name, "sum", label_count, label_keys, label_values);
-  if (r) return r;
-
-  const char *sum_l_value = prom_metric_formatter_dump(self->metric_formatter);
-  if (sum_l_value == NULL) return 1;
-
-  r = prom_linked_list_append(self->l_value_list, prom_strdup(sum_l_value));
-  if (r) return r;
-
-  r = prom_map_set(self->l_values, "sum", (char *)sum_l_value);
-  if (r) return r;
-
-  prom_metric_sample_t *sum_sample = prom_metric_sample_new(PROM_HISTOGRAM, sum_l_value, 0.0);
-  if (sum_sample == NULL) return 1;
-
-  return prom_map_set(self->samples, sum_l_value, sum_sample);
-}
-
 int prom_metric_sample_histogram_destroy(prom_metric_sample_histogram_t *self) {
   PROM_ASSERT(self != NULL);
-  int r = 0;
-  int ret = 0;
-
   if (self == NULL) return 0;
 
-  r = prom_linked_list_destroy(self->l_value_list);
-  self->l_value_list = NULL;
-  if (r) ret = r;
-
-  r = prom_map_destroy(self->samples);
-  if (r) ret = r;
-  self->samples = NULL;
+  prom_free(self->rows_mem);
+  self->rows_mem = NULL;
+  self->rows = NULL;
 
-  r = prom_map_destroy(self->l_values);
-  if (r) ret = r;
-  self->l_values = NULL;
-
-  r = prom_metric_formatter_destroy(self->metric_formatter);
-  if (r) ret = r;
-  self->metric_formatter = NULL;
-
-  r = pthread_rwlock_destroy(self->rwlock);
-  if (r) ret = r;
-
-  prom_free(self->rwlock);
-  self->rwlock = NULL;
+  // Every chunk is in the current table exactly once, and the tables it replaced only hold chunks it has as well
+  prom_metric_sample_histogram_chunks_t *chunks = atomic_load(&self->chunks);
+  if (chunks != NULL) {
+    for (size_t i = 0; i <= chunks->mask; i++) prom_free(atomic_load_explicit(&chunks->slots[i], memory_order_relaxed));
+    pthread_mutex_destroy(&self->chunks_lock);
+  }
+  while (chunks != NULL) {
+    prom_metric_sample_histogram_chunks_t *prev = chunks->prev;
+    prom_free(chunks);
+    chunks = prev;
+  }
+  atomic_store(&self->chunks, NULL);
 
   prom_free(self);
   self = NULL;
-  return ret;
+  return 0;
 }
 
 int prom_metric_sample_histogram_destroy_generic(void *gen) {
@@ -316,194 +226,127 @@ void prom_metric_sample_histogram_free_generic(void *gen) {
   prom_metric_sample_histogram_destroy(self);
 }
 
-int prom_metric_sample_histogram_observe(prom_metric_sample_histogram_t *self, double value) {
-  int r = 0;
-
-  r = pthread_rwlock_wrlock(self->rwlock);
-  if (r) {
-    printf("RETURN CODE: %d\n", r);
-    PROM_LOG(PROM_PTHREAD_RWLOCK_LOCK_ERROR);
-    return r;
+/**
+ * @brief API PRIVATE Adds value to the sum of row
+ */
+static inline void prom_metric_sample_histogram_add_sum(prom_metric_sample_histogram_row_t *row, double value) {
+  double sum = atomic_load_explicit(&row->sum, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&row->sum, &sum, sum + value, memory_order_relaxed,
+                                                memory_order_relaxed)) {
   }
+}
 
-#define PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(r) \
-  int rr = 0;                                                 \
-  rr = pthread_rwlock_unlock(self->rwlock);                   \
-  if (rr) {                                                   \
-    PROM_LOG(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR);               \
-    return rr;                                                \
-  } else {                                                    \
-    return r;                                                 \
+/**
+ * @brief API PRIVATE Observes value in a sparse histogram series
+ */
+static int prom_metric_sample_histogram_observe_sparse(prom_metric_sample_histogram_t *self, double value) {
+  prom_metric_sample_histogram_row_t *row = prom_metric_sample_histogram_row(self, 0);
+  double magnitude = fabs(value);
+  if (!isfinite(value)) {
+    atomic_fetch_add_explicit(&row->buckets[0], 1, memory_order_relaxed);
+  } else if (magnitude <= self->sparse->zero_threshold) {
+    atomic_fetch_add_explicit(&self->zero_count, 1, memory_order_relaxed);
+  } else {
+    int32_t index = prom_histogram_sparse_index(self->sparse, magnitude);
+    int32_t first = index & ~(int32_t)(PROM_METRIC_SAMPLE_HISTOGRAM_CHUNK_SIZE - 1);
+    bool negative = value < 0;
+    prom_metric_sample_histogram_chunks_t *chunks = atomic_load_explicit(&self->chunks, memory_order_acquire);
+    prom_metric_sample_histogram_chunk_t *chunk = prom_metric_sample_histogram_chunk_find(chunks, first, negative);
+    if (chunk == NULL) chunk = prom_metric_sample_histogram_chunk_add(self, first, negative);
+    if (chunk == NULL) return 1;
+    atomic_fetch_add_explicit(&chunk->counts[index - first], 1, memory_order_relaxed);
   }
+  prom_metric_sample_histogram_add_sum(row, value);
+  return 0;
+}
 
-  // Update the counter for the proper bucket if found
-  int bucket_count = prom_histogram_buckets_count(self->buckets);
-  for (int i = (bucket_count - 1); i >= 0; i--) {
-    if (value > self->buckets->upper_bounds[i]) {
-      break;
-    }
-
-    const char *bucket_key = prom_metric_sample_histogram_bucket_to_str(self->buckets->upper_bounds[i]);
-    if (bucket_key == NULL) {
-      PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1)
-    }
-
-    const char *l_value = prom_map_get(self->l_values, bucket_key);
-    if (l_value == NULL) {
-      prom_free((void *)bucket_key);
-      PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1)
-    }
-
-    prom_metric_sample_t *sample = prom_map_get(self->samples, l_value);
-    if (sample == NULL) {
-      prom_free((void *)bucket_key);
-      PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1)
-    }
-
-    prom_free((void *)bucket_key);
-    r = prom_metric_sample_add(sample, 1.0);
-    if (r) {
-      PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(r);
+int prom_metric_sample_histogram_observe(prom_metric_sample_histogram_t *self, double value) {
+  PROM_ASSERT(self != NULL);
+  if (self->sparse != NULL) return prom_metric_sample_histogram_observe_sparse(self, value);
+
+  // Binary search for the first upper bound at or above value. Bounds are sorted, and a value above all of them
+  // lands in the last bucket, which only counts towards le="+Inf".
+  const double *upper_bounds = self->buckets->upper_bounds;
+  size_t bucket_count = prom_histogram_buckets_count(self->buckets);
+  size_t low = 0;
+  size_t high = bucket_count;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (upper_bounds[mid] < value) {
+      low = mid + 1;
+    } else {
+      high = mid;
     }
   }
 
-  // Update the +Inf and count samples
-  const char *inf_l_value = prom_map_get(self->l_values, "+Inf");
-  if (inf_l_value == NULL) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1);
-  }
-
-  prom_metric_sample_t *inf_sample = prom_map_get(self->samples, inf_l_value);
-  if (inf_sample == NULL) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1);
-  }
-
-  r = prom_metric_sample_add(inf_sample, 1.0);
-  if (r) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1);
-  }
-
-  const char *count_l_value = prom_map_get(self->l_values, "count");
-  if (count_l_value == NULL) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1);
-  }
-
-  prom_metric_sample_t *count_sample = prom_map_get(self->samples, count_l_value);
-  if (count_sample == NULL) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1);
-  }
-
-  r = prom_metric_sample_add(count_sample, 1.0);
-  if (r) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1);
-  }
-
-  // Update the sum sample
-  const char *sum_l_value = prom_map_get(self->l_values, "sum");
-  if (sum_l_value == NULL) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1);
-  }
-
-  prom_metric_sample_t *sum_sample = prom_map_get(self->samples, sum_l_value);
-  if (sum_sample == NULL) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(1);
-  }
-
-  r = prom_metric_sample_add(sum_sample, value);
-  PROM_METRIC_SAMPLE_HISTOGRAM_OBSERVE_HANDLE_UNLOCK(r);
-  return r;
+  // Every counter is updated atomically and scrapes read them without locking, so observations need no lock either.
+  // Only the bucket the value falls in is incremented. The cumulative le values and the count are derived from the
+  // buckets at scrape, so they are always consistent with each other.
+  size_t row_index = self->row_mask == 0 ? 0 : (prom_metric_sample_cell_index() & self->row_mask);
+  prom_metric_sample_histogram_row_t *row = prom_metric_sample_histogram_row(self, row_index);
+  atomic_fetch_add_explicit(&row->buckets[low], 1, memory_order_relaxed);
+  prom_metric_sample_histogram_add_sum(row, value);
+  return 0;
 }
 
-static const char *prom_metric_sample_histogram_l_value_for_bucket(prom_metric_sample_histogram_t *self,
-                                                                   const char *name, size_t label_count,
-                                                                   const char **label_keys, const char **label_values,
-                                                                   double bucket) {
+uint64_t prom_metric_sample_histogram_bucket(prom_metric_sample_histogram_t *self, size_t i) {
   PROM_ASSERT(self != NULL);
-  int r = 0;
-
-#define PROM_METRIC_SAMPLE_HISTOGRAM_L_VALUE_FOR_BUCKET_CLEANUP() \
-  for (size_t i = 0; i < label_count + 1; i++) {                  \
-    prom_free((char *)new_keys[i]);                               \
-    prom_free((char *)new_values[i]);                             \
-  }                                                               \
-  prom_free(new_keys);                                            \
-  prom_free(new_values);
-
-  // Make new array to hold label_keys with le label key
-  const char **new_keys = (const char **)prom_malloc((label_count + 1) * sizeof(char *));
-  for (size_t i = 0; i < label_count; i++) {
-    new_keys[i] = prom_strdup(label_keys[i]);
+  uint64_t count = 0;
+  for (size_t j = 0; j <= self->row_mask; j++) {
+    count += atomic_load_explicit(&prom_metric_sample_histogram_row(self, j)->buckets[i], memory_order_relaxed);
   }
-  new_keys[label_count] = prom_strdup("le");
-
-  // Make new array to hold label_values with le label value
-  const char **new_values = (const char **)prom_malloc((label_count + 1) * sizeof(char *));
-  for (size_t i = 0; i < label_count; i++) {
-    new_values[i] = prom_strdup(label_values[i]);
-  }
-
-  new_values[label_count] = prom_metric_sample_histogram_bucket_to_str(bucket);
-
-  r = prom_metric_formatter_load_l_value(self->metric_formatter, name, NULL, label_count + 1, new_keys, new_values);
-  if (r) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_L_VALUE_FOR_BUCKET_CLEANUP();
-    return NULL;
-  }
-  const char *ret = (const char *)prom_metric_formatter_dump(self->metric_formatter);
-  PROM_METRIC_SAMPLE_HISTOGRAM_L_VALUE_FOR_BUCKET_CLEANUP();
-  return ret;
+  return count;
 }
 
-static const char *prom_metric_sample_histogram_l_value_for_inf(prom_metric_sample_histogram_t *self, const char *name,
-                                                                size_t label_count, const char **label_keys,
-                                                                const char **label_values) {
+double prom_metric_sample_histogram_sum(prom_metric_sample_histogram_t *self) {
   PROM_ASSERT(self != NULL);
-  int r = 0;
-
-#define PROM_METRIC_SAMPLE_HISTOGRAM_L_VALUE_FOR_INF_CLEANUP() \
-  for (size_t i = 0; i < label_count + 1; i++) {               \
-    prom_free((char *)new_keys[i]);                            \
-    prom_free((char *)new_values[i]);                          \
-  }                                                            \
-  prom_free(new_keys);                                         \
-  prom_free(new_values);
-
-  // Make new array to hold label_keys with le label key
-  const char **new_keys = (const char **)prom_malloc((label_count + 1) * sizeof(char *));
-  for (size_t i = 0; i < label_count; i++) {
-    new_keys[i] = prom_strdup(label_keys[i]);
-  }
-  new_keys[label_count] = prom_strdup("le");
-
-  // Make new array to hold label_values with le label value
-  const char **new_values = (const char **)prom_malloc((label_count + 1) * sizeof(char *));
-  for (size_t i = 0; i < label_count; i++) {
-    new_values[i] = prom_strdup(label_values[i]);
+  double sum = 0.0;
+  for (size_t j = 0; j <= self->row_mask; j++) {
+    sum += atomic_load_explicit(&prom_metric_sample_histogram_row(self, j)->sum, memory_order_relaxed);
   }
+  return sum;
+}
 
-  new_values[label_count] = prom_strdup("+Inf");
-
-  r = prom_metric_formatter_load_l_value(self->metric_formatter, name, NULL, label_count + 1, new_keys, new_values);
-  if (r) {
-    PROM_METRIC_SAMPLE_HISTOGRAM_L_VALUE_FOR_INF_CLEANUP()
-    return NULL;
+void prom_metric_sample_histogram_sparse_counts(prom_metric_sample_histogram_t *self, uint64_t *counts) {
+  PROM_ASSERT(self != NULL && self->sparse != NULL);
+  prom_histogram_sparse_t *sparse = self->sparse;
+  for (size_t i = 0; i < sparse->text_count; i++) counts[i] = 0;
+
+  // The zero bucket and the negative buckets all lie below the lowest le value, and the bucket of non-finite
+  // observations above the highest one
+  counts[0] += atomic_load_explicit(&self->zero_count, memory_order_relaxed);
+  counts[sparse->text_count] = prom_metric_sample_histogram_bucket(self, 0);
+
+  // Chunks added after the table is loaded are left for the next scrape, just like observations made after it
+  prom_metric_sample_histogram_chunks_t *chunks = atomic_load_explicit(&self->chunks, memory_order_acquire);
+  for (size_t i = 0; i <= chunks->mask; i++) {
+    prom_metric_sample_histogram_chunk_t *chunk = atomic_load_explicit(&chunks->slots[i], memory_order_acquire);
+    if (chunk == NULL) continue;
+    for (size_t j = 0; j < PROM_METRIC_SAMPLE_HISTOGRAM_CHUNK_SIZE; j++) {
+      uint64_t count = atomic_load_explicit(&chunk->counts[j], memory_order_relaxed);
+      if (count == 0) continue;
+      size_t bucket = chunk->negative ? 0 : prom_histogram_sparse_text_bucket(sparse, chunk->first + (int32_t)j);
+      counts[bucket] += count;
+    }
   }
-  const char *ret = (const char *)prom_metric_formatter_dump(self->metric_formatter);
-  PROM_METRIC_SAMPLE_HISTOGRAM_L_VALUE_FOR_INF_CLEANUP()
-  return ret;
 }
 
-static void prom_metric_sample_histogram_free_str_generic(void *gen) {
-  char *str = (char *)gen;
-  prom_free((void *)str);
-  str = NULL;
+int prom_metric_sample_histogram_format_bucket(double bucket, char *buf, size_t size) {
+  PROM_ASSERT(buf != NULL);
+  int len = snprintf(buf, size, "%g", bucket);
+  if (len < 0 || (size_t)len + 2 >= size) return 1;
+  if (!strchr(buf, '.')) {
+    strcat(buf, ".0");
+  }
+  return 0;
 }
 
-char *prom_metric_sample_histogram_bucket_to_str(double bucket) {
-  char *buf = (char *)prom_malloc(sizeof(char) * 50);
-  sprintf(buf, "%g", bucket);
-  if (!strchr(buf, '.')) {
+int prom_metric_sample_histogram_format_bound(double bound, char *buf, size_t size) {
+  PROM_ASSERT(buf != NULL);
+  int len = snprintf(buf, size, "%.17g", bound);
+  if (len < 0 || (size_t)len + 2 >= size) return 1;
+  if (!strpbrk(buf, ".e")) {
     strcat(buf, ".0");
   }
-  return buf;
+  return 0;
 }
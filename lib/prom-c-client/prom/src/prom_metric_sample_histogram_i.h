@@ -17,6 +17,9 @@
 #ifndef PROM_METRIC_HISTOGRAM_SAMPLE_I_H
 #define PROM_METRIC_HISTOGRAM_SAMPLE_I_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 // Public
 #include "prom_metric_sample_histogram.h"
 
@@ -25,10 +28,15 @@
 
 /**
  * @brief API PRIVATE Create a pointer to a prom_metric_sample_histogram_t
+ *
+ * @param buckets The upper bounds of the histogram. They MUST outlive the sample
+ * @param sparse The layout of a sparse histogram, in which case buckets is ignored, or NULL. It MUST outlive the
+ *               sample
+ * @param cell_count The number of rows of counters to stripe observations over, rounded up to a power of two, or 0 for
+ *                   one row. Sparse histograms always have one row
  */
-prom_metric_sample_histogram_t *prom_metric_sample_histogram_new(const char *name, prom_histogram_buckets_t *buckets,
-                                                                 size_t label_count, const char **label_keys,
-                                                                 const char **label_vales);
+prom_metric_sample_histogram_t *prom_metric_sample_histogram_new(prom_histogram_buckets_t *buckets,
+                                                                 prom_histogram_sparse_t *sparse, size_t cell_count);
 
 /**
  * @brief API PRIVATE Destroy a prom_metric_sample_histogram_t
@@ -40,8 +48,41 @@ int prom_metric_sample_histogram_destroy(prom_metric_sample_histogram_t *self);
  */
 int prom_metric_sample_histogram_destroy_generic(void *gen);
 
-char *prom_metric_sample_histogram_bucket_to_str(double bucket);
+/**
+ * @brief API PRIVATE Writes the le label value of the bucket with the given upper bound into buf. Returns non-zero if
+ * buf is too small.
+ */
+int prom_metric_sample_histogram_format_bucket(double bucket, char *buf, size_t size);
+
+/**
+ * @brief API PRIVATE Same as prom_metric_sample_histogram_format_bucket for the le value of a sparse histogram, with
+ * as many digits as it takes to tell neighbouring bounds apart
+ */
+int prom_metric_sample_histogram_format_bound(double bound, char *buf, size_t size);
 
 void prom_metric_sample_histogram_free_generic(void *gen);
 
+/**
+ * @brief API PRIVATE Returns the number of observations in the i-th bucket alone, i.e. above the previous upper bound
+ * and at or below the i-th. Bucket prom_histogram_buckets_count(buckets) holds the observations above every bound.
+ *
+ * The le value of a bucket is the sum of this for it and every bucket below it.
+ *
+ * A sparse histogram series has no bucket but the last, whose index is 0 and which holds the non-finite observations.
+ */
+uint64_t prom_metric_sample_histogram_bucket(prom_metric_sample_histogram_t *self, size_t i);
+
+/**
+ * @brief API PRIVATE Loads the number of observations of a sparse histogram series in each of its text buckets alone
+ *
+ * @param counts The counts, one per le value of the metric's text buckets from the lowest up plus a last one for the
+ *               observations above every le value. It MUST have room for text_count + 1 of them
+ */
+void prom_metric_sample_histogram_sparse_counts(prom_metric_sample_histogram_t *self, uint64_t *counts);
+
+/**
+ * @brief API PRIVATE Returns the sum of the observations
+ */
+double prom_metric_sample_histogram_sum(prom_metric_sample_histogram_t *self);
+
 #endif  // PROM_METRIC_HISTOGRAM_SAMPLE_I_H
@@ -15,25 +15,82 @@
  */
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 // Public
 #include "prom_histogram_buckets.h"
 #include "prom_metric_sample_histogram.h"
 
 // Private
-#include "prom_map_t.h"
-#include "prom_metric_formatter_t.h"
+#include "prom_histogram_sparse_t.h"
+#include "prom_metric_sample_t.h"
 
 #ifndef PROM_METRIC_HISTOGRAM_SAMPLE_T_H
 #define PROM_METRIC_HISTOGRAM_SAMPLE_T_H
 
+// The number of consecutive buckets of a sparse histogram that are allocated together
+#define PROM_METRIC_SAMPLE_HISTOGRAM_CHUNK_SIZE 16
+
+/**
+ * @brief API PRIVATE The counters of a histogram series that one stripe of threads adds to.
+ *
+ * The counts of the buckets follow the row in memory, one per upper bound in the order of the bounds plus a last one
+ * for the observations above every bound. A row takes sizeof(prom_metric_sample_histogram_row_t) plus 8 bytes per
+ * bucket, rounded up to whole cache lines so that rows never share a line.
+ *
+ * Buckets are not cumulative. An observation only increments the bucket it falls in, and the le values, _count
+ * included, are added up when the histogram is exposed.
+ */
+typedef struct prom_metric_sample_histogram_row {
+  _Atomic double sum;         /**< the sum of the observations */
+  _Atomic uint64_t buckets[]; /**< the number of observations in each bucket alone */
+} prom_metric_sample_histogram_row_t;
+
+/**
+ * @brief API PRIVATE A run of consecutive buckets of a sparse histogram series, allocated once an observation falls in
+ * any of them
+ */
+typedef struct prom_metric_sample_histogram_chunk {
+  int32_t first;                                                /**< the index of the first bucket */
+  bool negative;                                                /**< whether the buckets are the negative ones */
+  _Atomic uint64_t counts[PROM_METRIC_SAMPLE_HISTOGRAM_CHUNK_SIZE]; /**< the number of observations in each bucket */
+} prom_metric_sample_histogram_chunk_t;
+
+/**
+ * @brief API PRIVATE The chunks of a sparse histogram series, in an open-addressing table probed linearly from the
+ * hash of the first bucket.
+ *
+ * Observations look chunks up without locking. Chunks are never removed, and adding one takes the series' chunk lock.
+ * A table that fills up is replaced by one twice its size, and the old table is kept until the series is destroyed, so
+ * that observations still probing it are safe. An observation that misses a chunk in an old table just takes the lock
+ * and finds it in the current one.
+ */
+typedef struct prom_metric_sample_histogram_chunks {
+  size_t mask;                                             /**< the number of slots minus one, a power of two */
+  struct prom_metric_sample_histogram_chunks *prev;        /**< the table this one replaced, or NULL */
+  _Atomic(prom_metric_sample_histogram_chunk_t *) slots[]; /**< the chunks, NULL in empty slots */
+} prom_metric_sample_histogram_chunks_t;
+
+/**
+ * @brief API PRIVATE One histogram series. Its counters are plain atomics laid out in one contiguous block, and its
+ * l_values are only rendered from the series' labels when the histogram is exposed.
+ *
+ * The series of a sparse histogram has a single row without any bucket but the one above every bound, which counts
+ * the observations that are not finite. Its other buckets live in chunks.
+ */
 struct prom_metric_sample_histogram {
-  prom_linked_list_t *l_value_list;
-  prom_map_t *l_values;
-  prom_map_t *samples;
-  prom_metric_formatter_t *metric_formatter;
-  prom_histogram_buckets_t *buckets;
-  pthread_rwlock_t *rwlock;
+  prom_metric_sample_state_t state;  /**< state of the series */
+  prom_histogram_buckets_t *buckets; /**< the upper bounds, owned by the metric */
+  size_t row_mask;                   /**< the number of rows minus one. The number of rows is a power of two */
+  size_t row_size;                   /**< the size of a row in bytes, a multiple of the cache line */
+  unsigned char *rows;               /**< the rows, aligned to a cache line */
+  void *rows_mem;                    /**< the allocation rows was aligned within */
+  prom_histogram_sparse_t *sparse;   /**< the layout of a sparse histogram, owned by the metric, otherwise NULL */
+  _Atomic(prom_metric_sample_histogram_chunks_t *) chunks; /**< the populated buckets of a sparse histogram */
+  size_t chunk_count;                /**< the number of chunks in chunks, only accessed under chunks_lock */
+  pthread_mutex_t chunks_lock;       /**< serializes adding chunks */
+  _Atomic uint64_t zero_count;       /**< the number of observations in the zero bucket of a sparse histogram */
 };
 
 #endif  // PROM_METRIC_HISTOGRAM_SAMPLE_T_H
@@ -20,14 +20,53 @@
 #ifndef PROM_METRIC_SAMPLE_I_H
 #define PROM_METRIC_SAMPLE_I_H
 
+/**
+ * @brief API PRIVATE The cell index of the calling thread plus one, or 0 if it has not been assigned one yet
+ */
+extern __thread unsigned prom_metric_sample_thread_cell;
+
+/**
+ * @brief API PRIVATE Assigns the calling thread the next cell index round-robin and returns it
+ */
+unsigned prom_metric_sample_cell_assign(void);
+
+/**
+ * @brief API PRIVATE Returns the cell index of the calling thread. Striped data masks it with its number of cells minus
+ * one, so that a thread keeps to the same cell of everything it updates.
+ */
+static inline unsigned prom_metric_sample_cell_index(void) {
+  unsigned cell = prom_metric_sample_thread_cell;
+  if (cell == 0) return prom_metric_sample_cell_assign();
+  return cell - 1;
+}
+
 /**
  * @brief API PRIVATE Return a prom_metric_sample_t*
  *
+ * A sample does not keep its l_value, e.g. metric_name{foo="bar"}. It is rendered from the labels of the series the
+ * sample belongs to when the sample is exposed.
+ *
  * @param type The type of metric sample
- * @param l_value The entire left value of the metric e.g metric_name{foo="bar"}
  * @param r_value A double representing the value of the sample
+ * @param cell_count The number of cells to stripe additions over, rounded up to a power of two, or 0 for none. Samples
+ *                   of gauges are never striped
+ * @param allocator The allocator to allocate the sample from
+ */
+prom_metric_sample_t *prom_metric_sample_new(prom_metric_type_t type, double r_value, size_t cell_count,
+                                             const prom_allocator_t *allocator);
+
+/**
+ * @brief API PRIVATE Returns the current value of the sample, summing the cells of a striped sample
+ */
+double prom_metric_sample_value(prom_metric_sample_t *self);
+
+/**
+ * @brief API PRIVATE Formats the current value of the sample into buf as exposition text.
+ *
+ * Counter and histogram samples that were only ever added whole numbers are printed as exact integers. Everything else
+ * is printed as a double.
  */
-prom_metric_sample_t *prom_metric_sample_new(prom_metric_type_t type, const char *l_value, double r_value);
+int prom_metric_sample_format_value(prom_metric_sample_t *self, char *buf, size_t size);
 
 /**
  * @brief API PRIVATE Destroy the prom_metric_sample**
@@ -0,0 +1,505 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Public
+#include "prom_alloc.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_metric_sample_summary_i.h"
+#include "prom_sweeper_i.h"
+
+static uint64_t prom_metric_sample_summary_monotonic_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief API PRIVATE Returns a new buffer, closed to observers until it is made the current one
+ */
+static prom_metric_sample_summary_buffer_t *prom_metric_sample_summary_buffer_new(void) {
+  prom_metric_sample_summary_buffer_t *buffer =
+      (prom_metric_sample_summary_buffer_t *)prom_malloc(sizeof(prom_metric_sample_summary_buffer_t));
+  if (buffer == NULL) return NULL;
+  atomic_init(&buffer->claimed, PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE);
+  atomic_init(&buffer->filled, 0);
+  buffer->next = NULL;
+  return buffer;
+}
+
+static void prom_metric_sample_summary_buffer_list_free(prom_metric_sample_summary_buffer_t *buffer) {
+  while (buffer != NULL) {
+    prom_metric_sample_summary_buffer_t *next = buffer->next;
+    prom_free(buffer);
+    buffer = next;
+  }
+}
+
+prom_metric_sample_summary_t *prom_metric_sample_summary_new(const double *quantiles, size_t quantile_count,
+                                                             uint64_t max_age_ms, size_t age_bucket_count) {
+  PROM_ASSERT(quantiles != NULL && age_bucket_count > 0);
+  prom_metric_sample_summary_t *self =
+      (prom_metric_sample_summary_t *)prom_malloc(sizeof(prom_metric_sample_summary_t));
+  if (self == NULL) return NULL;
+
+  // The error of a quantile q is min(q, 1 - q) / 10, e, and its term of the invariant is 2 * e * rank / q at or above
+  // its rank and 2 * e * (count - rank) / (1 - q) below
+  self->targets = (prom_metric_sample_summary_target_t *)prom_malloc(sizeof(prom_metric_sample_summary_target_t) *
+                                                                     quantile_count);
+  if (self->targets == NULL) {
+    prom_free(self);
+    return NULL;
+  }
+  for (size_t i = 0; i < quantile_count; i++) {
+    double q = quantiles[i];
+    double error = (q < 0.5 ? q : 1 - q) / 10;
+    self->targets[i].quantile = q;
+    self->targets[i].above = 2 * error / q;
+    self->targets[i].below = 2 * error / (1 - q);
+  }
+
+  self->streams = (prom_metric_sample_summary_stream_t *)prom_malloc(sizeof(prom_metric_sample_summary_stream_t) *
+                                                                     age_bucket_count);
+  if (self->streams == NULL) {
+    prom_free(self->targets);
+    prom_free(self);
+    return NULL;
+  }
+  prom_metric_sample_summary_buffer_t *buffer = prom_metric_sample_summary_buffer_new();
+  if (buffer == NULL) {
+    prom_free(self->streams);
+    prom_free(self->targets);
+    prom_free(self);
+    return NULL;
+  }
+  // The first buffer is the current one from the start
+  atomic_store_explicit(&buffer->claimed, 0, memory_order_relaxed);
+  for (size_t i = 0; i < age_bucket_count; i++) {
+    self->streams[i].count = 0;
+    self->streams[i].size = 0;
+    self->streams[i].capacity = 0;
+    self->streams[i].entries = NULL;
+  }
+
+  prom_sweeper_state_init(&self->state);
+  self->quantiles = quantiles;
+  self->quantile_count = quantile_count;
+  self->count = 0;
+  self->sum = 0.0;
+  atomic_init(&self->current, buffer);
+  atomic_init(&self->spare, NULL);
+  atomic_init(&self->retired, NULL);
+  self->buffer_count = 1;
+  pthread_mutex_init(&self->lock, NULL);
+  self->stream_count = age_bucket_count;
+  self->head = 0;
+  self->stream_ms = max_age_ms / age_bucket_count;
+  self->head_expires_ms = prom_metric_sample_summary_monotonic_ms() + self->stream_ms;
+  self->scratch = NULL;
+  self->scratch_capacity = 0;
+  return self;
+}
+
+int prom_metric_sample_summary_destroy(prom_metric_sample_summary_t *self) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 0;
+
+  for (size_t i = 0; i < self->stream_count; i++) prom_free(self->streams[i].entries);
+  prom_free(self->streams);
+  self->streams = NULL;
+  prom_free(self->targets);
+  self->targets = NULL;
+  prom_free(self->scratch);
+  self->scratch = NULL;
+  // Every buffer is on exactly one of these
+  prom_free(atomic_load(&self->current));
+  prom_metric_sample_summary_buffer_list_free(atomic_load(&self->spare));
+  prom_metric_sample_summary_buffer_list_free(atomic_load(&self->retired));
+  pthread_mutex_destroy(&self->lock);
+  prom_free(self);
+  self = NULL;
+  return 0;
+}
+
+void prom_metric_sample_summary_free_generic(void *gen) {
+  prom_metric_sample_summary_t *self = (prom_metric_sample_summary_t *)gen;
+  prom_metric_sample_summary_destroy(self);
+}
+
+/**
+ * @brief API PRIVATE Returns how far apart in rank the entries of a stream of count observations may be around rank.
+ *
+ * This is the invariant of the CKMS algorithm for targeted quantiles. Entries are only merged where the invariant
+ * allows it, so the stream stays accurate near the quantiles and gets coarse everywhere else.
+ */
+static double prom_metric_sample_summary_invariant(prom_metric_sample_summary_t *self, double count, double rank) {
+  double min = DBL_MAX;
+  for (size_t i = 0; i < self->quantile_count; i++) {
+    prom_metric_sample_summary_target_t *target = &self->targets[i];
+    double f = target->quantile * count <= rank ? target->above * rank : target->below * (count - rank);
+    if (f < min) min = f;
+  }
+  return min;
+}
+
+/**
+ * @brief API PRIVATE Merges away the entries of stream that the invariant does not need, from the top down
+ */
+static void prom_metric_sample_summary_compress(prom_metric_sample_summary_t *self,
+                                                prom_metric_sample_summary_stream_t *stream) {
+  if (stream->size < 2) return;
+
+  prom_metric_sample_summary_entry_t *entries = stream->entries;
+  size_t kept = stream->size - 1;
+  prom_metric_sample_summary_entry_t x = entries[kept];
+  double rank = stream->count - 1 - x.width;
+  for (size_t i = stream->size - 1; i-- > 0;) {
+    prom_metric_sample_summary_entry_t c = entries[i];
+    if (c.width + x.width + x.delta <= prom_metric_sample_summary_invariant(self, stream->count, rank)) {
+      x.width += c.width;
+      entries[kept] = x;
+    } else {
+      x = c;
+      entries[--kept] = c;
+    }
+    rank -= c.width;
+  }
+  stream->size -= kept;
+  memmove(entries, entries + kept, stream->size * sizeof(prom_metric_sample_summary_entry_t));
+}
+
+/**
+ * @brief API PRIVATE Merges count sorted values into stream. The caller MUST hold the series' lock.
+ */
+static int prom_metric_sample_summary_merge_locked(prom_metric_sample_summary_t *self,
+                                                   prom_metric_sample_summary_stream_t *stream, const double *values,
+                                                   size_t count) {
+  size_t needed = stream->size + count;
+  if (self->scratch_capacity < needed) {
+    size_t capacity = self->scratch_capacity == 0 ? PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE : self->scratch_capacity;
+    while (capacity < needed) capacity *= 2;
+    prom_metric_sample_summary_entry_t *scratch = (prom_metric_sample_summary_entry_t *)prom_realloc(
+        self->scratch, capacity * sizeof(prom_metric_sample_summary_entry_t));
+    if (scratch == NULL) return 1;
+    self->scratch = scratch;
+    self->scratch_capacity = capacity;
+  }
+
+  // A new entry that lands between existing ones may be anywhere within the invariant of their ranks
+  prom_metric_sample_summary_entry_t *out = self->scratch;
+  size_t n = 0;
+  size_t i = 0;
+  double rank = 0;
+  for (size_t j = 0; j < count; j++) {
+    for (; i < stream->size && stream->entries[i].value <= values[j]; i++) {
+      rank += stream->entries[i].width;
+      out[n++] = stream->entries[i];
+    }
+    double delta = 0;
+    if (i < stream->size) {
+      delta = floor(prom_metric_sample_summary_invariant(self, stream->count, rank)) - 1;
+      if (delta < 0) delta = 0;
+    }
+    out[n].value = values[j];
+    out[n].width = 1;
+    out[n++].delta = delta;
+    stream->count += 1;
+    rank += 1;
+  }
+  for (; i < stream->size; i++) out[n++] = stream->entries[i];
+
+  // The stream takes the merged entries, and its old array is the scratch space of the next merge
+  size_t out_capacity = self->scratch_capacity;
+  self->scratch = stream->entries;
+  self->scratch_capacity = stream->capacity;
+  stream->entries = out;
+  stream->capacity = out_capacity;
+  stream->size = n;
+  prom_metric_sample_summary_compress(self, stream);
+  return 0;
+}
+
+/**
+ * @brief API PRIVATE Resets the streams whose age bucket has expired. The caller MUST hold the series' lock.
+ */
+static void prom_metric_sample_summary_rotate_locked(prom_metric_sample_summary_t *self) {
+  uint64_t now = prom_metric_sample_summary_monotonic_ms();
+  for (size_t i = 0; now >= self->head_expires_ms; i++) {
+    // Once every stream has been reset, the window starts over from now
+    if (i == self->stream_count) {
+      self->head_expires_ms = now + self->stream_ms;
+      break;
+    }
+    self->streams[self->head].count = 0;
+    self->streams[self->head].size = 0;
+    self->head = (self->head + 1) % self->stream_count;
+    self->head_expires_ms += self->stream_ms;
+  }
+}
+
+/**
+ * @brief API PRIVATE Sorts the count values, using tmp, which MUST hold as many, as scratch space. Returns the sorted
+ * values, which are either in values or in tmp.
+ *
+ * This is a bottom-up merge sort, which unlike qsort compares inline and is several times faster on a buffer.
+ */
+static double *prom_metric_sample_summary_sort(double *values, double *tmp, size_t count) {
+  for (size_t width = 1; width < count; width *= 2) {
+    for (size_t low = 0; low < count; low += 2 * width) {
+      size_t mid = low + width < count ? low + width : count;
+      size_t high = low + 2 * width < count ? low + 2 * width : count;
+      size_t i = low;
+      size_t j = mid;
+      size_t k = low;
+      while (i < mid && j < high) tmp[k++] = values[j] < values[i] ? values[j++] : values[i++];
+      while (i < mid) tmp[k++] = values[i++];
+      while (j < high) tmp[k++] = values[j++];
+    }
+    double *swap = values;
+    values = tmp;
+    tmp = swap;
+  }
+  return values;
+}
+
+/**
+ * @brief API PRIVATE Copies the first count values of buffer into values once they have all been written
+ */
+static void prom_metric_sample_summary_buffer_copy(prom_metric_sample_summary_buffer_t *buffer, size_t count,
+                                                   double *values) {
+  // An observer that claimed a slot is at most a store away from filling it
+  while (atomic_load_explicit(&buffer->filled, memory_order_acquire) < count) sched_yield();
+  for (size_t i = 0; i < count; i++) values[i] = atomic_load_explicit(&buffer->values[i], memory_order_relaxed);
+}
+
+/**
+ * @brief API PRIVATE Pushes buffer onto list, which may be pushed onto by several threads at once
+ */
+static void prom_metric_sample_summary_buffer_push(_Atomic(prom_metric_sample_summary_buffer_t *) *list,
+                                                   prom_metric_sample_summary_buffer_t *buffer) {
+  buffer->next = atomic_load_explicit(list, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(list, &buffer->next, buffer, memory_order_release,
+                                                memory_order_relaxed)) {
+  }
+}
+
+/**
+ * @brief API PRIVATE Makes a spare buffer, or a new one if there is none and the series may have another, the current
+ * one. Returns non-zero if there is no buffer to make the current one.
+ *
+ * Only whoever closed the current buffer may call this, so there is never more than one thread taking buffers off the
+ * spare list, which is what keeps that list safe from ABA.
+ */
+static int prom_metric_sample_summary_buffer_replace(prom_metric_sample_summary_t *self) {
+  prom_metric_sample_summary_buffer_t *buffer = atomic_load_explicit(&self->spare, memory_order_acquire);
+  while (buffer != NULL && !atomic_compare_exchange_weak_explicit(&self->spare, &buffer, buffer->next,
+                                                                  memory_order_acquire, memory_order_acquire)) {
+  }
+  if (buffer == NULL) {
+    if (self->buffer_count == PROM_METRIC_SAMPLE_SUMMARY_BUFFER_MAX) return 1;
+    buffer = prom_metric_sample_summary_buffer_new();
+    if (buffer == NULL) return 1;
+    self->buffer_count++;
+  }
+
+  // The buffer is only opened once it is the current one, so that an observer still holding it from before it was
+  // retired cannot fill it up while it is not
+  atomic_store_explicit(&buffer->filled, 0, memory_order_relaxed);
+  atomic_store_explicit(&self->current, buffer, memory_order_release);
+  atomic_store_explicit(&buffer->claimed, 0, memory_order_release);
+  return 0;
+}
+
+/**
+ * @brief API PRIVATE Reopens buffer, which MUST be the current one and closed, once its values have been copied out
+ */
+static void prom_metric_sample_summary_buffer_reopen(prom_metric_sample_summary_buffer_t *buffer) {
+  // filled goes back to 0 first, so that it only counts slots claimed from then on
+  atomic_store_explicit(&buffer->filled, 0, memory_order_relaxed);
+  atomic_store_explicit(&buffer->claimed, 0, memory_order_release);
+}
+
+/**
+ * @brief API PRIVATE Merges the count values into every stream. The caller MUST hold the series' lock.
+ */
+static int prom_metric_sample_summary_flush_locked(prom_metric_sample_summary_t *self, double *values, size_t count) {
+  int r = 0;
+  double tmp[PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE];
+
+  // NaN has no rank, so it only counts towards the count and the sum
+  size_t ranked = 0;
+  for (size_t i = 0; i < count; i++) {
+    self->sum += values[i];
+    if (!isnan(values[i])) values[ranked++] = values[i];
+  }
+  self->count += count;
+
+  prom_metric_sample_summary_rotate_locked(self);
+  double *sorted = prom_metric_sample_summary_sort(values, tmp, ranked);
+  for (size_t i = 0; i < self->stream_count; i++) {
+    int ret = prom_metric_sample_summary_merge_locked(self, &self->streams[i], sorted, ranked);
+    if (ret) r = ret;
+  }
+  return r;
+}
+
+/**
+ * @brief API PRIVATE Merges every retired buffer and puts it back on the spare list. The caller MUST hold the series'
+ * lock.
+ */
+static int prom_metric_sample_summary_drain_locked(prom_metric_sample_summary_t *self) {
+  int r = 0;
+  double values[PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE];
+
+  prom_metric_sample_summary_buffer_t *buffer = atomic_exchange_explicit(&self->retired, NULL, memory_order_acquire);
+  while (buffer != NULL) {
+    prom_metric_sample_summary_buffer_t *next = buffer->next;
+    prom_metric_sample_summary_buffer_copy(buffer, PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE, values);
+    prom_metric_sample_summary_buffer_push(&self->spare, buffer);
+    int ret = prom_metric_sample_summary_flush_locked(self, values, PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE);
+    if (ret) r = ret;
+    buffer = next;
+  }
+  return r;
+}
+
+/**
+ * @brief API PRIVATE Merges the retired buffers unless another thread holds the series' lock, in which case that thread
+ * merges them before it lets go
+ */
+static int prom_metric_sample_summary_drain(prom_metric_sample_summary_t *self) {
+  int r = 0;
+  for (;;) {
+    // A buffer retired while another thread holds the lock is either taken by that thread or seen here by it once it
+    // has let go, since the fence orders retiring before trying the lock and letting go before looking again
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&self->retired, memory_order_relaxed) == NULL) return r;
+    if (pthread_mutex_trylock(&self->lock) != 0) return r;
+    int ret = prom_metric_sample_summary_drain_locked(self);
+    if (ret) r = ret;
+    pthread_mutex_unlock(&self->lock);
+  }
+}
+
+int prom_metric_sample_summary_observe(prom_metric_sample_summary_t *self, double value) {
+  PROM_ASSERT(self != NULL);
+  int r = 0;
+
+  // The count and the sum are added up when the buffer is merged, so that an observation costs two atomic increments
+  for (;;) {
+    prom_metric_sample_summary_buffer_t *buffer = atomic_load_explicit(&self->current, memory_order_acquire);
+    size_t slot = atomic_fetch_add_explicit(&buffer->claimed, 1, memory_order_acquire);
+    if (slot >= PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE) {
+      // The buffer is being replaced or reopened, which never waits for a merge
+      sched_yield();
+      continue;
+    }
+
+    // Claiming the last slot closes the buffer, so it is up to this thread to replace it, which it does before filling
+    // the slot to keep other observers from finding it closed for long
+    int replaced = 0;
+    if (slot == PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE - 1) {
+      replaced = !prom_metric_sample_summary_buffer_replace(self);
+    }
+    atomic_store_explicit(&buffer->values[slot], value, memory_order_relaxed);
+    atomic_fetch_add_explicit(&buffer->filled, 1, memory_order_release);
+    if (slot < PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE - 1) return 0;
+
+    if (replaced) {
+      prom_metric_sample_summary_buffer_push(&self->retired, buffer);
+      return prom_metric_sample_summary_drain(self);
+    }
+
+    // Every buffer is waiting to be merged, so this thread merges a copy of this one and the others itself
+    double values[PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE];
+    prom_metric_sample_summary_buffer_copy(buffer, PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE, values);
+    prom_metric_sample_summary_buffer_reopen(buffer);
+    pthread_mutex_lock(&self->lock);
+    r = prom_metric_sample_summary_drain_locked(self);
+    int ret = prom_metric_sample_summary_flush_locked(self, values, PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE);
+    if (ret) r = ret;
+    pthread_mutex_unlock(&self->lock);
+    ret = prom_metric_sample_summary_drain(self);
+    return ret ? ret : r;
+  }
+}
+
+int prom_metric_sample_summary_load(prom_metric_sample_summary_t *self, double *values, uint64_t *count, double *sum) {
+  PROM_ASSERT(self != NULL);
+  int r = 0;
+  int ret = 0;
+  double copy[PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE];
+
+  pthread_mutex_lock(&self->lock);
+
+  // Close the current buffer and merge what has been filled. A buffer that was already full is retired by the
+  // observer that filled it up, and merged below if that has happened yet.
+  prom_metric_sample_summary_buffer_t *buffer = atomic_load_explicit(&self->current, memory_order_acquire);
+  size_t claimed =
+      atomic_exchange_explicit(&buffer->claimed, PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE, memory_order_acquire);
+  if (claimed < PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE) {
+    // Observers go on with a spare buffer if there is one, and otherwise only wait for the copy
+    if (prom_metric_sample_summary_buffer_replace(self)) {
+      prom_metric_sample_summary_buffer_copy(buffer, claimed, copy);
+      prom_metric_sample_summary_buffer_reopen(buffer);
+    } else {
+      prom_metric_sample_summary_buffer_copy(buffer, claimed, copy);
+      prom_metric_sample_summary_buffer_push(&self->spare, buffer);
+    }
+    r = prom_metric_sample_summary_flush_locked(self, copy, claimed);
+  }
+  ret = prom_metric_sample_summary_drain_locked(self);
+  if (ret) r = ret;
+  prom_metric_sample_summary_rotate_locked(self);
+
+  prom_metric_sample_summary_stream_t *stream = &self->streams[self->head];
+  for (size_t i = 0; i < self->quantile_count; i++) {
+    if (stream->size == 0) {
+      values[i] = NAN;
+      continue;
+    }
+
+    // The first entry whose rank may be past the target rank by more than half the invariant ends the search
+    double target = ceil(self->quantiles[i] * stream->count);
+    target += ceil(prom_metric_sample_summary_invariant(self, stream->count, target) / 2);
+    prom_metric_sample_summary_entry_t *prev = &stream->entries[0];
+    double rank = 0;
+    for (size_t j = 1; j < stream->size; j++) {
+      prom_metric_sample_summary_entry_t *entry = &stream->entries[j];
+      rank += prev->width;
+      if (rank + entry->width + entry->delta > target) break;
+      prev = entry;
+    }
+    values[i] = prev->value;
+  }
+  *count = self->count;
+  *sum = self->sum;
+
+  pthread_mutex_unlock(&self->lock);
+  ret = prom_metric_sample_summary_drain(self);
+  return ret ? ret : r;
+}
@@ -0,0 +1,59 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PROM_METRIC_SAMPLE_SUMMARY_I_H
+#define PROM_METRIC_SAMPLE_SUMMARY_I_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Public
+#include "prom_metric_sample_summary.h"
+
+// Private
+#include "prom_metric_sample_summary_t.h"
+
+/**
+ * @brief API PRIVATE Create a pointer to a prom_metric_sample_summary_t
+ *
+ * @param quantiles The quantiles to expose, each strictly between 0 and 1. They MUST outlive the sample
+ * @param quantile_count The number of quantiles
+ * @param max_age_ms The length of the sliding window in milliseconds
+ * @param age_bucket_count The number of streams the window is made of
+ */
+prom_metric_sample_summary_t *prom_metric_sample_summary_new(const double *quantiles, size_t quantile_count,
+                                                             uint64_t max_age_ms, size_t age_bucket_count);
+
+/**
+ * @brief API PRIVATE Destroy a prom_metric_sample_summary_t
+ */
+int prom_metric_sample_summary_destroy(prom_metric_sample_summary_t *self);
+
+void prom_metric_sample_summary_free_generic(void *gen);
+
+/**
+ * @brief API PRIVATE Merges the observations made so far and loads what a scrape exposes, all from the same
+ * observations. Returns non-zero upon failure.
+ *
+ * @param values Set to the estimate of each quantile of the sliding window. It MUST hold quantile_count doubles. The
+ *               estimates are NaN if nothing was observed within the window
+ * @param count Set to the number of observations
+ * @param sum Set to the sum of the observations
+ */
+int prom_metric_sample_summary_load(prom_metric_sample_summary_t *self, double *values, uint64_t *count, double *sum);
+
+#endif  // PROM_METRIC_SAMPLE_SUMMARY_I_H
@@ -0,0 +1,118 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PROM_METRIC_SAMPLE_SUMMARY_T_H
+#define PROM_METRIC_SAMPLE_SUMMARY_T_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Public
+#include "prom_metric_sample_summary.h"
+
+// Private
+#include "prom_metric_sample_t.h"
+
+// The number of observations a summary series buffers before merging them into its streams
+#define PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE 256
+
+// The number of buffers a summary series allocates at most. Observers only wait for a merge once all of them are full.
+#define PROM_METRIC_SAMPLE_SUMMARY_BUFFER_MAX 4
+
+/**
+ * @brief API PRIVATE An entry of a quantile stream, a tuple of the CKMS algorithm
+ */
+typedef struct prom_metric_sample_summary_entry {
+  double value; /**< an observed value */
+  double width; /**< the number of observations the entry stands for, i.e. the rank it adds */
+  double delta; /**< how much the rank of value may exceed the sum of the widths up to and including this entry */
+} prom_metric_sample_summary_entry_t;
+
+/**
+ * @brief API PRIVATE A quantile of a summary along with the factors of its term of the CKMS invariant, which are
+ * derived from its error
+ */
+typedef struct prom_metric_sample_summary_target {
+  double quantile; /**< the quantile */
+  double above;    /**< the factor of the rank at or above the quantile's rank */
+  double below;    /**< the factor of the distance from the top rank below the quantile's rank */
+} prom_metric_sample_summary_target_t;
+
+/**
+ * @brief API PRIVATE A CKMS stream, which estimates the quantiles of a summary within their error from a sorted list
+ * of entries that is compressed as observations are merged in
+ */
+typedef struct prom_metric_sample_summary_stream {
+  double count;                                /**< the number of observations merged into the stream */
+  size_t size;                                 /**< the number of entries */
+  size_t capacity;                             /**< the number of entries that fit into entries */
+  prom_metric_sample_summary_entry_t *entries; /**< the entries, sorted by value */
+} prom_metric_sample_summary_stream_t;
+
+/**
+ * @brief API PRIVATE A buffer of observations that have not been merged into the streams of a summary series yet
+ */
+typedef struct prom_metric_sample_summary_buffer {
+  _Atomic size_t claimed;                                        /**< the number of slots handed out */
+  _Atomic size_t filled;                                         /**< the number of slots written */
+  struct prom_metric_sample_summary_buffer *next;                /**< the next buffer of the list it is on */
+  _Atomic double values[PROM_METRIC_SAMPLE_SUMMARY_BUFFER_SIZE]; /**< the observations */
+} prom_metric_sample_summary_buffer_t;
+
+/**
+ * @brief API PRIVATE One summary series.
+ *
+ * Observations go into the current buffer without locking: an observer claims a slot, writes it and counts it as
+ * filled. The observer that claims the last slot makes a spare buffer the current one and puts the full one on the
+ * retired list. It then merges the retired buffers into every stream if lock is free, and otherwise leaves them to the
+ * thread holding it, which merges whatever has been retired before letting go. Observers therefore never wait for a
+ * merge, unless all PROM_METRIC_SAMPLE_SUMMARY_BUFFER_MAX buffers are waiting to be merged. In that case the observer
+ * that claims the last slot copies the buffer out, hands it out again and merges the copy once it gets lock.
+ *
+ * A scrape takes lock, closes the current buffer to new observers and merges what has been filled so far along with the
+ * retired buffers. The count and the sum are only added to while merging, so that they always agree with the
+ * quantiles. Buffers are only freed with the series, so an observer that still holds a buffer that is no longer the
+ * current one just finds it closed and tries again.
+ *
+ * Each stream is one age bucket of the sliding window. Every stream gets every observation, the quantiles are read
+ * from the head stream, which is the oldest one, and the head stream is reset and becomes the newest one every
+ * stream_ms milliseconds.
+ */
+struct prom_metric_sample_summary {
+  prom_metric_sample_state_t state;                              /**< state of the series */
+  const double *quantiles;                                       /**< the quantiles to expose, owned by the metric */
+  size_t quantile_count;                                         /**< the number of quantiles */
+  prom_metric_sample_summary_target_t *targets;                  /**< the quantiles with their invariant factors */
+  _Atomic(prom_metric_sample_summary_buffer_t *) current;        /**< the buffer observations go into */
+  _Atomic(prom_metric_sample_summary_buffer_t *) spare;          /**< the buffers ready to become the current one */
+  _Atomic(prom_metric_sample_summary_buffer_t *) retired;        /**< the full buffers waiting to be merged */
+  size_t buffer_count; /**< the number of buffers, only touched by whoever replaces the current one */
+  pthread_mutex_t lock;                                          /**< serializes merging and querying the streams */
+  uint64_t count;                                                /**< the number of observations merged */
+  double sum;                                                    /**< the sum of the observations merged */
+  prom_metric_sample_summary_stream_t *streams;                  /**< the age buckets */
+  size_t stream_count;                                           /**< the number of age buckets */
+  size_t head;                                                   /**< the index of the oldest stream */
+  uint64_t head_expires_ms;                                      /**< when the head stream is reset, in ms */
+  uint64_t stream_ms;                                            /**< the time between two resets */
+  prom_metric_sample_summary_entry_t *scratch;                   /**< where streams are merged into before swapping */
+  size_t scratch_capacity;                                       /**< the number of entries that fit into scratch */
+};
+
+#endif  // PROM_METRIC_SAMPLE_SUMMARY_T_H
@@ -17,13 +17,54 @@
 #ifndef PROM_METRIC_SAMPLE_T_H
 #define PROM_METRIC_SAMPLE_T_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "prom_alloc.h"
 #include "prom_metric_sample.h"
 #include "prom_metric_t.h"
 
+#define PROM_METRIC_SAMPLE_CACHE_LINE 64
+
+/**
+ * @brief API PRIVATE One slot of a striped sample. Each cell fills a whole cache line so that threads adding to
+ * different cells never touch the same line.
+ */
+typedef struct prom_metric_sample_cell {
+  _Alignas(PROM_METRIC_SAMPLE_CACHE_LINE) _Atomic uint64_t count; /**< whole-number additions to this cell */
+  _Atomic double value;                                           /**< fractional additions to this cell */
+} prom_metric_sample_cell_t;
+
+/**
+ * @brief API PRIVATE What the series sweeper needs to know about a series of a metric with a TTL
+ */
+typedef struct prom_metric_sample_state {
+  _Atomic uint64_t touched; /**< the sweeper clock when the series was last updated */
+  _Atomic bool pinned;      /**< set once the series has been handed out to the user, who may hold on to it */
+  _Atomic bool evicted;     /**< set by the sweeper while it evicts the series, and for good once it has */
+} prom_metric_sample_state_t;
+
+/**
+ * @brief API PRIVATE A metric sample.
+ *
+ * Samples that are never set or subtracted from, i.e. those of counters and histograms, add whole numbers to the
+ * integer count with a single fetch-and-add and only fall back to a compare-and-swap loop on the double r_value for
+ * fractional amounts. Their value is count + r_value, and it is exact up to 2^64 as long as only whole numbers were
+ * added. Gauge samples keep their whole value in r_value.
+ *
+ * A striped sample spreads additions over cell_mask + 1 cells picked by the calling thread, and the cells are added to
+ * its value. Only counter and histogram samples are striped.
+ */
 struct prom_metric_sample {
-  prom_metric_type_t type; /**< type is the metric type for the sample */
-  char *l_value;           /**< l_value is the full metric name and label set represeted as a string */
-  _Atomic double r_value;  /**< r_value is the value of the metric sample */
+  prom_metric_type_t type;           /**< type is the metric type for the sample */
+  prom_metric_sample_state_t state;  /**< state of the series the sample is the only sample of, if it is one */
+  _Atomic double r_value;            /**< r_value is the value of the metric sample, or its fractional part */
+  _Atomic uint64_t count;            /**< the whole-number part of the value of a counter or histogram sample */
+  const prom_allocator_t *allocator; /**< allocator the sample was allocated from */
+  prom_metric_sample_cell_t *cells;  /**< the cells of a striped sample, otherwise NULL */
+  size_t cell_mask;                  /**< the number of cells minus one. The number of cells is a power of two */
+  void *cells_mem;                   /**< the allocation cells was aligned within */
 };
 
 #endif  // PROM_METRIC_SAMPLE_T_H
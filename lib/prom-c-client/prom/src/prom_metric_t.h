@@ -18,13 +18,18 @@
 #define PROM_METRIC_T_H
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 // Public
+#include "prom_alloc.h"
 #include "prom_histogram_buckets.h"
 #include "prom_metric.h"
 
 // Private
 #include "prom_map_i.h"
+#include "prom_histogram_sparse_t.h"
 #include "prom_map_t.h"
 #include "prom_metric_formatter_t.h"
 
@@ -39,19 +44,33 @@ typedef enum prom_metric_type { PROM_COUNTER, PROM_GAUGE, PROM_HISTOGRAM, PROM_S
 extern char *prom_metric_type_map[4];
 
 /**
- * @brief API PRIVATE An opaque struct to users containing metric metadata; one or more metric samples; and a metric
- * formatter for locating metric samples and exporting metric data
+ * @brief API PRIVATE An opaque struct to users containing metric metadata and one or more metric samples
  */
 struct prom_metric {
-  prom_metric_type_t type;            /**< metric_type      The type of metric */
-  const char *name;                   /**< name             The name of the metric */
-  const char *help;                   /**< help             The help output for the metric */
-  prom_map_t *samples;                /**< samples          Map comprised of samples for the given metric */
-  prom_histogram_buckets_t *buckets;  /**< buckets          Array of histogram bucket upper bound values */
-  size_t label_key_count;             /**< label_keys_count The count of labe_keys*/
-  prom_metric_formatter_t *formatter; /**< formatter        The metric formatter  */
-  pthread_rwlock_t *rwlock;           /**< rwlock           Required for locking on certain non-atomic operations */
-  const char **label_keys;            /**< labels           Array comprised of const char **/
+  prom_metric_type_t type;           /**< metric_type      The type of metric */
+  const char *name;                  /**< name             The name of the metric */
+  const char *help;                  /**< help             The help output for the metric */
+  prom_map_t *samples;               /**< samples          Map of series key to sample for the given metric */
+  prom_histogram_buckets_t *buckets; /**< buckets          Array of histogram bucket upper bound values */
+  prom_histogram_sparse_t *sparse;   /**< sparse           The bucket layout of a sparse histogram, otherwise NULL */
+  double *quantiles;                 /**< quantiles        The quantiles a summary exposes, otherwise NULL */
+  size_t quantile_count;             /**< quantile_count   The number of quantiles */
+  uint64_t max_age_ms;               /**< max_age_ms       The sliding window of a summary in milliseconds */
+  size_t age_bucket_count;           /**< age_bucket_count The number of age buckets the window is made of */
+  size_t label_key_count;            /**< label_keys_count The count of labe_keys*/
+  pthread_rwlock_t *rwlock;          /**< rwlock           Required for locking on certain non-atomic operations */
+  const char **label_keys;           /**< labels           Array comprised of const char **/
+  const prom_allocator_t *allocator; /**< allocator        Allocator for label_keys and new samples */
+  prom_metric_sample_t *unlabeled;   /**< unlabeled        The only sample of a counter or gauge without labels */
+  _Atomic bool unlabeled_used;       /**< unlabeled_used   Set once unlabeled has been handed out and is exposed */
+  size_t cell_count;                 /**< cell_count       The number of cells new samples are striped over, or 0 */
+  uint64_t ttl_ms;                   /**< ttl_ms           Milliseconds after which idle series are evicted, or 0 */
+  _Atomic size_t max_series;         /**< max_series       The most series samples may hold, or 0 for no limit */
+  _Atomic size_t series_count;       /**< series_count     The number of series in samples */
+  void *overflow;                    /**< overflow         The series new label sets go to once max_series is hit */
+  _Atomic bool overflow_used;        /**< overflow_used    Set once a label set has gone to overflow */
+  prom_metric_value_fn value_fn;     /**< value_fn         Computes the value of a callback metric, otherwise NULL */
+  void *value_ctx;                   /**< value_ctx        The context value_fn is called with */
 };
 
 #endif  // PROM_METRIC_T_H
@@ -0,0 +1,196 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Public
+#include "prom_alloc.h"
+
+// Private
+#include "prom_pool_i.h"
+#include "prom_pool_t.h"
+
+// AddressSanitizer cannot see use-after-free or overflows within pooled memory, so sanitized builds use the allocator
+// directly.
+#if defined(__SANITIZE_ADDRESS__)
+#define PROM_POOL_PASSTHROUGH
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define PROM_POOL_PASSTHROUGH
+#endif
+#endif
+
+// The smallest size class. Each following class is twice the size of the previous one.
+#define PROM_POOL_MIN_SIZE 16
+
+// The number of size classes. Objects larger than the largest class are not pooled.
+#define PROM_POOL_CLASS_COUNT 5
+
+// The number of objects moved between a thread cache and the shared free list at once
+#define PROM_POOL_BATCH 32
+
+// The number of objects carved out of each chunk
+#define PROM_POOL_CHUNK_OBJECTS 64
+
+#define PROM_POOL_CLASS_INIT(size) \
+  { .object_size = (size), .lock = PTHREAD_MUTEX_INITIALIZER, .free = NULL, .free_count = 0 }
+
+static prom_pool_class_t prom_pool_classes[PROM_POOL_CLASS_COUNT] = {
+    PROM_POOL_CLASS_INIT(16), PROM_POOL_CLASS_INIT(32), PROM_POOL_CLASS_INIT(64), PROM_POOL_CLASS_INIT(128),
+    PROM_POOL_CLASS_INIT(256)};
+
+// Every chunk ever allocated, kept reachable so leak checkers do not report pooled memory
+static pthread_mutex_t prom_pool_chunks_lock = PTHREAD_MUTEX_INITIALIZER;
+static prom_pool_chunk_t *prom_pool_chunks = NULL;
+
+static __thread prom_pool_cache_t prom_pool_caches[PROM_POOL_CLASS_COUNT];
+static __thread bool prom_pool_cache_registered = false;
+
+static pthread_once_t prom_pool_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t prom_pool_key;
+
+/**
+ * @brief API PRIVATE Returns the index of the smallest class that fits size, or -1 if size is not pooled
+ */
+static inline int prom_pool_class_index(size_t size) {
+  size_t class_size = PROM_POOL_MIN_SIZE;
+  for (int i = 0; i < PROM_POOL_CLASS_COUNT; i++, class_size <<= 1) {
+    if (size <= class_size) return i;
+  }
+  return -1;
+}
+
+/**
+ * @brief API PRIVATE Moves count objects from the head of cache onto the shared free list of pool_class
+ */
+static void prom_pool_cache_flush(prom_pool_class_t *pool_class, prom_pool_cache_t *cache, size_t count) {
+  if (count == 0) return;
+  prom_pool_object_t *first = cache->head;
+  prom_pool_object_t *last = first;
+  for (size_t i = 1; i < count; i++) last = last->next;
+  cache->head = last->next;
+  cache->count -= count;
+
+  pthread_mutex_lock(&pool_class->lock);
+  last->next = pool_class->free;
+  pool_class->free = first;
+  pool_class->free_count += count;
+  pthread_mutex_unlock(&pool_class->lock);
+}
+
+/**
+ * @brief API PRIVATE Hands every object cached by an exiting thread back to the shared free lists
+ */
+static void prom_pool_thread_exit(void *item) {
+  for (int i = 0; i < PROM_POOL_CLASS_COUNT; i++) {
+    prom_pool_cache_flush(&prom_pool_classes[i], &prom_pool_caches[i], prom_pool_caches[i].count);
+  }
+}
+
+static void prom_pool_key_init(void) { pthread_key_create(&prom_pool_key, prom_pool_thread_exit); }
+
+/**
+ * @brief API PRIVATE Fills an empty thread cache from the shared free list, carving a new chunk if that is empty too
+ */
+static int prom_pool_cache_refill(prom_pool_class_t *pool_class, prom_pool_cache_t *cache) {
+  if (!prom_pool_cache_registered) {
+    pthread_once(&prom_pool_key_once, prom_pool_key_init);
+    // Any non-NULL value makes the destructor run when the thread exits
+    pthread_setspecific(prom_pool_key, prom_pool_caches);
+    prom_pool_cache_registered = true;
+  }
+
+  pthread_mutex_lock(&pool_class->lock);
+  if (pool_class->free != NULL) {
+    prom_pool_object_t *first = pool_class->free;
+    prom_pool_object_t *last = first;
+    size_t count = 1;
+    while (count < PROM_POOL_BATCH && last->next != NULL) {
+      last = last->next;
+      count++;
+    }
+    pool_class->free = last->next;
+    pool_class->free_count -= count;
+    pthread_mutex_unlock(&pool_class->lock);
+
+    last->next = NULL;
+    cache->head = first;
+    cache->count = count;
+    return 0;
+  }
+  pthread_mutex_unlock(&pool_class->lock);
+
+  prom_pool_chunk_t *chunk =
+      (prom_pool_chunk_t *)prom_malloc(sizeof(prom_pool_chunk_t) + pool_class->object_size * PROM_POOL_CHUNK_OBJECTS);
+  if (chunk == NULL) return 1;
+
+  pthread_mutex_lock(&prom_pool_chunks_lock);
+  chunk->next = prom_pool_chunks;
+  prom_pool_chunks = chunk;
+  pthread_mutex_unlock(&prom_pool_chunks_lock);
+
+  // Thread the new objects together in address order
+  char *base = chunk->objects;
+  prom_pool_object_t *next = NULL;
+  for (size_t i = PROM_POOL_CHUNK_OBJECTS; i > 0; i--) {
+    prom_pool_object_t *object = (prom_pool_object_t *)(base + (i - 1) * pool_class->object_size);
+    object->next = next;
+    next = object;
+  }
+  cache->head = next;
+  cache->count = PROM_POOL_CHUNK_OBJECTS;
+  return 0;
+}
+
+void *prom_pool_alloc(size_t size) {
+#ifdef PROM_POOL_PASSTHROUGH
+  return prom_malloc(size);
+#else
+  int i = prom_pool_class_index(size);
+  if (i < 0) return prom_malloc(size);
+
+  prom_pool_cache_t *cache = &prom_pool_caches[i];
+  if (cache->head == NULL && prom_pool_cache_refill(&prom_pool_classes[i], cache)) return NULL;
+
+  prom_pool_object_t *object = cache->head;
+  cache->head = object->next;
+  cache->count--;
+  return object;
+#endif
+}
+
+void prom_pool_free(void *ptr, size_t size) {
+  if (ptr == NULL) return;
+#ifdef PROM_POOL_PASSTHROUGH
+  prom_free(ptr);
+#else
+  int i = prom_pool_class_index(size);
+  if (i < 0) {
+    prom_free(ptr);
+    return;
+  }
+
+  prom_pool_cache_t *cache = &prom_pool_caches[i];
+  prom_pool_object_t *object = (prom_pool_object_t *)ptr;
+  object->next = cache->head;
+  cache->head = object;
+  cache->count++;
+
+  // Keep a thread that only frees, such as the one collecting retired entries, from hoarding objects
+  if (cache->count >= 2 * PROM_POOL_BATCH) prom_pool_cache_flush(&prom_pool_classes[i], cache, PROM_POOL_BATCH);
+#endif
+}
@@ -0,0 +1,36 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_POOL_I_INCLUDED
+#define PROM_POOL_I_INCLUDED
+
+#include <stddef.h>
+
+/**
+ * @brief API PRIVATE Returns an uninitialized object of at least size bytes.
+ *
+ * Small objects are served from per-thread free lists of fixed-size classes that are refilled in batches from a
+ * shared pool, so most calls never reach the allocator. Larger objects fall through to prom_malloc.
+ */
+void *prom_pool_alloc(size_t size);
+
+/**
+ * @brief API PRIVATE Returns an object obtained from prom_pool_alloc. size MUST be the size it was allocated with.
+ * Objects may be freed from any thread.
+ */
+void prom_pool_free(void *ptr, size_t size);
+
+#endif  // PROM_POOL_I_INCLUDED
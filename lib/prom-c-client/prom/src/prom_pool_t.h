@@ -0,0 +1,59 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_POOL_T_H
+#define PROM_POOL_T_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * @brief API PRIVATE A free object. The link overlays the first word of the object itself.
+ */
+typedef struct prom_pool_object {
+  struct prom_pool_object *next;
+} prom_pool_object_t;
+
+/**
+ * @brief API PRIVATE The shared state of one size class.
+ *
+ * Threads allocate from their own prom_pool_cache_t and only take the lock to move a batch of objects between their
+ * cache and this shared free list, or to carve a new chunk.
+ */
+typedef struct prom_pool_class {
+  size_t object_size;       /**< the size of every object in this class */
+  pthread_mutex_t lock;     /**< guards free and free_count */
+  prom_pool_object_t *free; /**< objects handed back by threads */
+  size_t free_count;        /**< the number of objects in free */
+} prom_pool_class_t;
+
+/**
+ * @brief API PRIVATE A thread's private stash of free objects of one size class
+ */
+typedef struct prom_pool_cache {
+  prom_pool_object_t *head; /**< free objects owned by the thread */
+  size_t count;             /**< the number of objects in head */
+} prom_pool_cache_t;
+
+/**
+ * @brief API PRIVATE A block of objects carved out of a single allocation. Chunks are never returned to the system.
+ */
+typedef struct prom_pool_chunk {
+  struct prom_pool_chunk *next; /**< the previously allocated chunk */
+  _Alignas(16) char objects[];  /**< the objects of the chunk, laid out back to back */
+} prom_pool_chunk_t;
+
+#endif  // PROM_POOL_T_H
@@ -0,0 +1,122 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+// Public
+#include "prom_summary.h"
+
+#include "prom_alloc.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_errors.h"
+#include "prom_log.h"
+#include "prom_map_i.h"
+#include "prom_metric_i.h"
+#include "prom_metric_sample_summary_i.h"
+#include "prom_metric_t.h"
+
+// The sliding window of a summary unless prom_summary_set_max_age says otherwise
+#define PROM_SUMMARY_DEFAULT_MAX_AGE_MS (10 * 60 * 1000)
+#define PROM_SUMMARY_DEFAULT_AGE_BUCKETS 5
+
+static const double prom_summary_default_quantiles[] = {0.5, 0.99, 0.999};
+
+prom_summary_t *prom_summary_new(const char *name, const char *help, size_t quantile_count, const double *quantiles,
+                                 size_t label_key_count, const char **label_keys) {
+  if (quantile_count == 0) {
+    quantile_count = sizeof(prom_summary_default_quantiles) / sizeof(prom_summary_default_quantiles[0]);
+    quantiles = prom_summary_default_quantiles;
+  }
+  for (size_t i = 0; i < quantile_count; i++) {
+    if (!(quantiles[i] > 0 && quantiles[i] < 1)) {
+      PROM_LOG(PROM_SUMMARY_INVALID_QUANTILE);
+      return NULL;
+    }
+  }
+
+  double *q = (double *)prom_malloc(sizeof(double) * quantile_count);
+  if (q == NULL) return NULL;
+  memcpy(q, quantiles, sizeof(double) * quantile_count);
+
+  prom_summary_t *self = (prom_summary_t *)prom_metric_new(PROM_SUMMARY, name, help, label_key_count, label_keys);
+  if (self == NULL) {
+    prom_free(q);
+    return NULL;
+  }
+  self->quantiles = q;
+  self->quantile_count = quantile_count;
+  self->max_age_ms = PROM_SUMMARY_DEFAULT_MAX_AGE_MS;
+  self->age_bucket_count = PROM_SUMMARY_DEFAULT_AGE_BUCKETS;
+  return self;
+}
+
+int prom_summary_destroy(prom_summary_t *self) {
+  PROM_ASSERT(self != NULL);
+
+  int r = 0;
+
+  if (self == NULL) return r;
+  r = prom_metric_destroy(self);
+  if (r) return r;
+  self = NULL;
+  return r;
+}
+
+int prom_summary_set_max_age(prom_summary_t *self, double max_age, size_t age_bucket_count) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 1;
+  if (self->type != PROM_SUMMARY) {
+    PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
+    return 1;
+  }
+  if (prom_map_size(self->samples) != 0) {
+    PROM_LOG(PROM_METRIC_SAMPLES_EXIST);
+    return 1;
+  }
+
+  // Each age bucket has to last at least a millisecond
+  if (age_bucket_count == 0 || !(max_age * 1000 >= (double)age_bucket_count)) {
+    PROM_LOG(PROM_SUMMARY_INVALID_MAX_AGE);
+    return 1;
+  }
+  self->max_age_ms = (uint64_t)(max_age * 1000);
+  self->age_bucket_count = age_bucket_count;
+  return 0;
+}
+
+int prom_summary_observe(prom_summary_t *self, double value, const char **label_values) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return 1;
+  if (self->type != PROM_SUMMARY) {
+    PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
+    return 1;
+  }
+  prom_batch_update_t update = {self, label_values, PROM_BATCH_OBSERVE, value};
+  return prom_metric_update(self, 1, &update);
+}
+
+prom_metric_sample_summary_t *prom_summary_labels(prom_summary_t *self, const char **label_values) {
+  PROM_ASSERT(self != NULL);
+  if (self == NULL) return NULL;
+  if (self->type != PROM_SUMMARY) {
+    PROM_LOG(PROM_METRIC_INCORRECT_TYPE);
+    return NULL;
+  }
+  return prom_metric_sample_summary_from_labels(self, label_values);
+}
@@ -0,0 +1,154 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+// Public
+#include "prom_alloc.h"
+#include "prom_counter.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_errors.h"
+#include "prom_log.h"
+#include "prom_metric_i.h"
+#include "prom_sweeper_i.h"
+#include "prom_sweeper_t.h"
+
+// Bounds of the time between two passes, which is a quarter of the shortest TTL otherwise
+#define PROM_SWEEPER_MIN_INTERVAL_MS 10
+#define PROM_SWEEPER_MAX_INTERVAL_MS 1000
+
+_Atomic uint64_t prom_sweeper_clock = 0;
+
+prom_counter_t *prom_series_evicted_total = NULL;
+
+static prom_sweeper_t prom_sweeper = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, false};
+
+static pthread_once_t prom_sweeper_once = PTHREAD_ONCE_INIT;
+
+// The monotonic time in milliseconds at which the sweeper clock would have been 0. The clock only runs while the
+// sweeper does, so that series do not age while no metric has a TTL.
+static uint64_t prom_sweeper_clock_base = 0;
+
+static void prom_sweeper_init_once(void) {
+  const char *help = "Series evicted for not being updated within the TTL of their metric.";
+  prom_series_evicted_total = prom_counter_new("prom_series_evicted_total", help, 1, (const char *[]){"metric"});
+}
+
+int prom_sweeper_init(void) {
+  pthread_once(&prom_sweeper_once, &prom_sweeper_init_once);
+  return prom_series_evicted_total == NULL;
+}
+
+static uint64_t prom_sweeper_monotonic_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief API PRIVATE Returns the time to wait before the next pass. The caller MUST hold the sweeper lock.
+ */
+static uint64_t prom_sweeper_interval_ms_internal(void) {
+  uint64_t interval = PROM_SWEEPER_MAX_INTERVAL_MS;
+  for (prom_sweeper_node_t *node = prom_sweeper.metrics; node != NULL; node = node->next) {
+    if (node->metric->ttl_ms / 4 < interval) interval = node->metric->ttl_ms / 4;
+  }
+  return interval < PROM_SWEEPER_MIN_INTERVAL_MS ? PROM_SWEEPER_MIN_INTERVAL_MS : interval;
+}
+
+static void *prom_sweeper_run(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&prom_sweeper.lock);
+  while (prom_sweeper.metrics != NULL) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t interval = prom_sweeper_interval_ms_internal();
+    deadline.tv_sec += interval / 1000;
+    deadline.tv_nsec += (long)(interval % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&prom_sweeper.cond, &prom_sweeper.lock, &deadline);
+
+    uint64_t now = prom_sweeper_monotonic_ms() - prom_sweeper_clock_base;
+    atomic_store_explicit(&prom_sweeper_clock, now, memory_order_relaxed);
+    for (prom_sweeper_node_t *node = prom_sweeper.metrics; node != NULL; node = node->next) {
+      size_t evicted = prom_metric_evict_stale_series(node->metric, now);
+      if (evicted > 0) {
+        prom_counter_add(prom_series_evicted_total, (double)evicted, (const char *[]){node->metric->name});
+      }
+    }
+  }
+  prom_sweeper.running = false;
+  pthread_mutex_unlock(&prom_sweeper.lock);
+  return NULL;
+}
+
+int prom_sweeper_set_ttl(prom_metric_t *metric, uint64_t ttl_ms) {
+  PROM_ASSERT(metric != NULL);
+  int r = 0;
+
+  r = prom_sweeper_init();
+  if (r) return r;
+
+  pthread_mutex_lock(&prom_sweeper.lock);
+
+  prom_sweeper_node_t **link = &prom_sweeper.metrics;
+  while (*link != NULL && (*link)->metric != metric) link = &(*link)->next;
+
+  if (ttl_ms == 0 && *link != NULL) {
+    prom_sweeper_node_t *node = *link;
+    *link = node->next;
+    prom_free(node);
+  } else if (ttl_ms != 0 && *link == NULL) {
+    prom_sweeper_node_t *node = (prom_sweeper_node_t *)prom_malloc(sizeof(prom_sweeper_node_t));
+    if (node == NULL) {
+      pthread_mutex_unlock(&prom_sweeper.lock);
+      return 1;
+    }
+    node->metric = metric;
+    node->next = prom_sweeper.metrics;
+    prom_sweeper.metrics = node;
+  }
+  metric->ttl_ms = ttl_ms;
+
+  if (prom_sweeper.metrics != NULL && !prom_sweeper.running) {
+    // Resume the clock where it stopped
+    prom_sweeper_clock_base =
+        prom_sweeper_monotonic_ms() - atomic_load_explicit(&prom_sweeper_clock, memory_order_relaxed);
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    r = pthread_create(&thread, &attr, &prom_sweeper_run, NULL);
+    pthread_attr_destroy(&attr);
+    if (r) {
+      PROM_LOG(PROM_PTHREAD_CREATE_ERROR);
+    } else {
+      prom_sweeper.running = true;
+    }
+  }
+  pthread_cond_signal(&prom_sweeper.cond);
+
+  pthread_mutex_unlock(&prom_sweeper.lock);
+  return r;
+}
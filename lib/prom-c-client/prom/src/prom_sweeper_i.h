@@ -0,0 +1,73 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The sweeper evicts the series of metrics with a TTL that have not been updated for longer than the TTL.
+//
+// It keeps a coarse clock in milliseconds that it advances on every pass. Updates copy the clock into the state of the
+// series they touch, which costs a store only when the clock has moved on since the last update. A pass walks the
+// samples map of every metric with a TTL under the metric's lock, which only writers creating series take, and evicts
+// the series whose clock is too old. Evicted samples are freed once no reader can reference them any more.
+
+#ifndef PROM_SWEEPER_I_H
+#define PROM_SWEEPER_I_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Private
+#include "prom_metric_sample_t.h"
+#include "prom_metric_t.h"
+
+/**
+ * @brief API PRIVATE The sweeper clock in milliseconds. It stands still while no metric has a TTL.
+ */
+extern _Atomic uint64_t prom_sweeper_clock;
+
+/**
+ * @brief API PRIVATE Initializes the state of a new series as touched now
+ */
+static inline void prom_sweeper_state_init(prom_metric_sample_state_t *state) {
+  atomic_init(&state->touched, atomic_load_explicit(&prom_sweeper_clock, memory_order_relaxed));
+  atomic_init(&state->pinned, false);
+  atomic_init(&state->evicted, false);
+}
+
+/**
+ * @brief API PRIVATE Records that the series is being updated. The caller MUST check state->evicted after applying the
+ * update, and redo the update on a fresh series if it is set.
+ *
+ * The store is sequentially consistent so that either the caller sees evicted set or the sweeper sees the new clock
+ * and keeps the series.
+ */
+static inline void prom_sweeper_touch(prom_metric_sample_state_t *state) {
+  uint64_t now = atomic_load_explicit(&prom_sweeper_clock, memory_order_relaxed);
+  if (atomic_load_explicit(&state->touched, memory_order_relaxed) != now) atomic_store(&state->touched, now);
+}
+
+/**
+ * @brief API PRIVATE Creates prom_series_evicted_total if it does not exist yet
+ * @return A non-zero integer value upon failure
+ */
+int prom_sweeper_init(void);
+
+/**
+ * @brief API PRIVATE Makes the series of metric expire ttl_ms milliseconds after their last update, or never if ttl_ms
+ * is 0. The sweeper thread is started when the first metric gets a TTL and stops when the last one loses it.
+ * @return A non-zero integer value upon failure
+ */
+int prom_sweeper_set_ttl(prom_metric_t *metric, uint64_t ttl_ms);
+
+#endif  // PROM_SWEEPER_I_H
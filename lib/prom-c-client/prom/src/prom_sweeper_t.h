@@ -0,0 +1,53 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_SWEEPER_T_H
+#define PROM_SWEEPER_T_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Public
+#include "prom_counter.h"
+
+// Private
+#include "prom_metric_t.h"
+
+/**
+ * @brief API PRIVATE Counts the series the sweeper has evicted, labeled by the name of their metric
+ */
+extern prom_counter_t *prom_series_evicted_total;
+
+/**
+ * @brief API PRIVATE A metric with a series TTL, in the sweeper's list
+ */
+typedef struct prom_sweeper_node {
+  prom_metric_t *metric;          /**< the metric to sweep */
+  struct prom_sweeper_node *next; /**< the next metric to sweep */
+} prom_sweeper_node_t;
+
+/**
+ * @brief API PRIVATE The process-wide series sweeper. Its lock is held for a whole pass, so a metric that is removed
+ * from the list is never swept again once prom_sweeper_set_ttl has taken it out.
+ */
+typedef struct prom_sweeper {
+  pthread_mutex_t lock;         /**< guards every other field and the ttl_ms of every metric */
+  pthread_cond_t cond;          /**< signaled when the list changes */
+  prom_sweeper_node_t *metrics; /**< the metrics to sweep */
+  bool running;                 /**< whether the sweeper thread is alive */
+} prom_sweeper_t;
+
+#endif  // PROM_SWEEPER_T_H
@@ -0,0 +1,106 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks that updating series that already exist never reaches the allocator. A counting allocator is installed with
+ * prom_allocator_set_default, every series is created once, and the count MUST stay at zero across the updates that
+ * follow.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "prom.h"
+
+#define PROM_ALLOC_TEST_UPDATES 100000
+
+static size_t prom_alloc_test_calls = 0;
+
+static void *prom_alloc_test_malloc(void *ctx, size_t size) {
+  prom_alloc_test_calls++;
+  return malloc(size);
+}
+
+static void *prom_alloc_test_calloc(void *ctx, size_t count, size_t size) {
+  prom_alloc_test_calls++;
+  return calloc(count, size);
+}
+
+static void *prom_alloc_test_realloc(void *ctx, void *ptr, size_t size) {
+  prom_alloc_test_calls++;
+  return realloc(ptr, size);
+}
+
+static void prom_alloc_test_free(void *ctx, void *ptr) {
+  if (ptr != NULL) prom_alloc_test_calls++;
+  free(ptr);
+}
+
+static const prom_allocator_t prom_alloc_test_allocator = {.malloc_fn = prom_alloc_test_malloc,
+                                                           .calloc_fn = prom_alloc_test_calloc,
+                                                           .realloc_fn = prom_alloc_test_realloc,
+                                                           .free_fn = prom_alloc_test_free,
+                                                           .ctx = NULL};
+
+static int prom_alloc_test_check(const char *what, size_t calls) {
+  if (calls == 0) return 0;
+  fprintf(stderr, "%s: %zu allocator calls across %d updates of existing series\n", what, calls,
+          PROM_ALLOC_TEST_UPDATES);
+  return 1;
+}
+
+int main(void) {
+  int r = 0;
+  prom_allocator_set_default(&prom_alloc_test_allocator);
+
+  const char *keys[] = {"path", "code"};
+  const char *labels[][2] = {{"/", "200"}, {"/api", "200"}, {"/api", "500"}, {"/metrics", "200"}};
+  const size_t label_count = sizeof(labels) / sizeof(labels[0]);
+
+  prom_counter_t *counter = prom_counter_new("test_requests_total", "requests", 2, keys);
+  prom_gauge_t *gauge = prom_gauge_new("test_in_flight", "requests in flight", 2, keys);
+  prom_histogram_t *histogram =
+      prom_histogram_new("test_latency_seconds", "latency", prom_histogram_buckets_exponential(0.001, 2, 12), 2, keys);
+  if (counter == NULL || gauge == NULL || histogram == NULL) {
+    fprintf(stderr, "failed to create the metrics\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < label_count; i++) {
+    prom_counter_inc(counter, labels[i]);
+    prom_gauge_set(gauge, 1, labels[i]);
+    prom_histogram_observe(histogram, 0.01, labels[i]);
+  }
+
+  prom_alloc_test_calls = 0;
+  for (int i = 0; i < PROM_ALLOC_TEST_UPDATES; i++) prom_counter_inc(counter, labels[i % label_count]);
+  r |= prom_alloc_test_check("prom_counter_inc", prom_alloc_test_calls);
+
+  prom_alloc_test_calls = 0;
+  for (int i = 0; i < PROM_ALLOC_TEST_UPDATES; i++) prom_gauge_set(gauge, i, labels[i % label_count]);
+  r |= prom_alloc_test_check("prom_gauge_set", prom_alloc_test_calls);
+
+  prom_alloc_test_calls = 0;
+  for (int i = 0; i < PROM_ALLOC_TEST_UPDATES; i++) {
+    prom_histogram_observe(histogram, i * 1e-6, labels[i % label_count]);
+  }
+  r |= prom_alloc_test_check("prom_histogram_observe", prom_alloc_test_calls);
+
+  prom_histogram_destroy(histogram);
+  prom_gauge_destroy(gauge);
+  prom_counter_destroy(counter);
+  return r;
+}
@@ -0,0 +1,88 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks that every series of a sparse histogram is exposed in the text format with the same fixed le values, however
+ * far apart its observations are, and that each le value counts exactly the observations at or below it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "prom.h"
+
+/**
+ * Returns the number of le values, +Inf included, that out has for the series with the given label line prefix
+ */
+static size_t le_count(const char *out, const char *prefix) {
+  size_t count = 0;
+  for (const char *p = strstr(out, prefix); p != NULL; p = strstr(p + 1, prefix)) count++;
+  return count;
+}
+
+int main(void) {
+  int r = 0;
+
+  r |= prom_collector_registry_default_init();
+  prom_histogram_t *histogram = prom_histogram_new_sparse("test_seconds", "sparse", 8, 0.0, 1e-6, 1e3, 1,
+                                                          (const char *[]){"path"});
+  if (r || histogram == NULL) {
+    fprintf(stderr, "failed to create the histogram\n");
+    return 1;
+  }
+  r |= prom_collector_registry_register_metric(histogram);
+
+  // The observations of /a are nine decades apart, those of /b are negative, zero or on a bucket bound
+  r |= prom_histogram_observe(histogram, 1e-6, (const char *[]){"/a"});
+  r |= prom_histogram_observe(histogram, 1e3, (const char *[]){"/a"});
+  r |= prom_histogram_observe(histogram, -2.0, (const char *[]){"/b"});
+  r |= prom_histogram_observe(histogram, 0.0, (const char *[]){"/b"});
+  r |= prom_histogram_observe(histogram, 0.5, (const char *[]){"/b"});
+
+  const char *out = prom_collector_registry_bridge(PROM_COLLECTOR_REGISTRY_DEFAULT);
+  if (out == NULL) {
+    fprintf(stderr, "failed to expose the histogram\n");
+    return 1;
+  }
+
+  size_t a = le_count(out, "test_seconds{path=\"/a\",le=");
+  size_t b = le_count(out, "test_seconds{path=\"/b\",le=");
+  if (a != b || a > PROM_HISTOGRAM_SPARSE_TEXT_BUCKETS_MAX + 1) {
+    fprintf(stderr, "expected the same le values of at most %d buckets, got %zu and %zu\n",
+            PROM_HISTOGRAM_SPARSE_TEXT_BUCKETS_MAX, a, b);
+    r = 1;
+  }
+
+  const char *expected[] = {
+      "test_seconds{path=\"/a\",le=\"1.9073486328125e-06\"} 1\n",
+      "test_seconds{path=\"/a\",le=\"512.0\"} 1\n",
+      "test_seconds{path=\"/a\",le=\"1024.0\"} 2\n",
+      "test_seconds{path=\"/b\",le=\"1.9073486328125e-06\"} 2\n",
+      "test_seconds{path=\"/b\",le=\"0.25\"} 2\n",
+      "test_seconds{path=\"/b\",le=\"0.5\"} 3\n",
+      "test_seconds{path=\"/b\",le=\"+Inf\"} 3\n",
+  };
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+    if (strstr(out, expected[i]) == NULL) {
+      fprintf(stderr, "missing %s", expected[i]);
+      r = 1;
+    }
+  }
+
+  prom_free((void *)out);
+  r |= prom_collector_registry_destroy(PROM_COLLECTOR_REGISTRY_DEFAULT);
+  return r != 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * Copyright 2019-2020 DigitalOcean Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks that a registry's allocator is not imposed on prom_series_evicted_total and
+ * prom_series_overflow_updates_total, which every process collector exposes but which outlive any one registry. A
+ * registry with process metrics is pointed at an arena, both are destroyed, and a metric is then pushed past its series
+ * limit, which adds a series to prom_series_overflow_updates_total. Built with AddressSanitizer, a counter left on the
+ * arena makes this a use-after-free.
+ */
+
+#include <stdio.h>
+
+#include "prom.h"
+
+int main(void) {
+  int r = 0;
+
+  prom_allocator_t *arena = prom_arena_allocator_new(0);
+  prom_collector_registry_t *registry = prom_collector_registry_new("test");
+  if (arena == NULL || registry == NULL) {
+    fprintf(stderr, "failed to create the registry\n");
+    return 1;
+  }
+  r |= prom_collector_registry_enable_process_metrics(registry);
+  r |= prom_collector_registry_set_allocator(registry, arena);
+  r |= prom_collector_registry_destroy(registry);
+  prom_arena_allocator_destroy(arena);
+
+  // A label value no earlier series used, so that prom_series_overflow_updates_total gets a new series
+  prom_counter_t *counter = prom_counter_new("test_capped_total", "capped", 1, (const char *[]){"path"});
+  if (counter == NULL) {
+    fprintf(stderr, "failed to create the counter\n");
+    return 1;
+  }
+  r |= prom_metric_set_max_series(counter, 1);
+  r |= prom_counter_inc(counter, (const char *[]){"/a"});
+  r |= prom_counter_inc(counter, (const char *[]){"/b"});
+  r |= prom_counter_destroy(counter);
+
+  if (r) fprintf(stderr, "a call failed\n");
+  return r != 0;
+}
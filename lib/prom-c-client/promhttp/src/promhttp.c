@@ -47,7 +47,9 @@ enum MHD_Result promhttp_handler(void *cls, struct MHD_Connection *connection, c
   }
   if (strcmp(url, "/metrics") == 0) {
     const char *buf = prom_collector_registry_bridge(PROM_ACTIVE_REGISTRY);
-    struct MHD_Response *response = MHD_create_response_from_buffer(strlen(buf), (void *)buf, MHD_RESPMEM_MUST_FREE);
+    // The buffer comes from the library's allocator, which is not necessarily the one MHD would free it with
+    struct MHD_Response *response =
+        MHD_create_response_from_buffer_with_free_callback(strlen(buf), (void *)buf, &prom_default_free);
     int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
     MHD_destroy_response(response);
     return ret;
@@ -40,42 +40,89 @@ enum memstats
     AVAIL
 };
 
-/** Métrica de Prometheus para el uso de CPU */
-static prom_gauge_t* cpu_usage_metric;
-/** Métrica de Prometheus para el uso porcentual de memoria */
-static prom_gauge_t* memory_usage_metric;
-/** Métrica de Prometheus para la memoria usada */
-static prom_gauge_t* memory_used_metric;
-/** Métrica de Prometheus para la memoria disponible */
-static prom_gauge_t* memory_available_metric;
-/** Metrica de Prometheeus para el nivel de bateria */
-static prom_gauge_t* battery_level_metric;
-/** Metrica de Prometheus para el numero de sys calls del proceso*/
-static prom_counter_t* sys_calls_metric;
-/** Metrica de Prometheus para la temperatura de CPU */
-static prom_gauge_t* cpu_temp_metric;
-/** Metrica de Prometheus para el numero de procesos en ejecucion en el sistema */
-static prom_gauge_t* number_of_processes_metric;
-/** Metrica de Prometheus para la carga promedio del sistema */
-static prom_gauge_t* avg_load_metric;
-/** Metrica de Prometheus para la velocidad de la CPU en MHz*/
-static prom_gauge_t* cpu_speed_metric;
-/** Metrica de Prometheus para la cantidad de lecturas de disco */
-static prom_gauge_t* disk_reads_metric;
-/** Metrica de Prometheus para la cantidad de escrituras de disco */
-static prom_gauge_t* disk_writes_metric;
-/** Metrica de Prometheus para la cantidad de operaciones de I/O en progreso */
-static prom_gauge_t* disk_io_inprogress_metric;
-/** Metrica de Prometheus para la cantidad de paquetes transmitidos descartados */
-static prom_gauge_t* network_tx_drops_metric;
-/** Metrica de Prometheus para la cantidad de errores en paquetes transmitidos */
-static prom_gauge_t* network_tx_errors_metric;
-/** Metrica de Prometheus para la cantidad de paquetes recibidos descartados */
-static prom_gauge_t* network_rx_drops_metric;
-/** Metrica de Prometheus para la cantidad de errores en paquetes recibidos */
-static prom_gauge_t* network_rx_errors_metric;
-/** Metrica de Prometheus para la cantidad de cambios de contexto */
-static prom_gauge_t* context_changes_metric;
+/**
+ * @brief Tabla de métricas expuestas, en el orden en que se registran. Cada entrada indica el identificador, el tipo
+ * (gauge o counter), el nombre, la ayuda, el flag del colector al que pertenece y la función que lee su valor al
+ * momento de cada consulta, o NULL si el bucle principal la actualiza. Agregar una métrica es agregar una línea.
+ */
+#define METRICS_TABLE(X)                                                                                               \
+    X(CPU_USAGE, gauge, "cpu_usage_percentage", "Porcentaje de uso de CPU", cpu_enabled, NULL)                         \
+    X(MEMORY_USAGE, gauge, "memory_usage_metric", "Porcentaje de memoria en uso", memory_enabled, NULL)                \
+    X(MEMORY_USED, gauge, "memory_used", "Memoria usada", memory_enabled, NULL)                                        \
+    X(MEMORY_AVAILABLE, gauge, "memory_available", "Memoria disponible", memory_enabled, NULL)                         \
+    X(CPU_SPEED, gauge, "cpu_speed", "Velocidad de la CPU", cpu_speed_enabled, get_cpu_speed)                          \
+    X(AVG_LOAD, gauge, "avg_load", "Carga promedio", avg_load_enabled, get_avg_load)                                   \
+    X(CPU_TEMP, gauge, "cpu_temp", "Temperatura de la CPU", cpu_temp_enabled, get_cpu_temp)                            \
+    X(NUMBER_OF_PROCESSES, gauge, "number_of_processes", "Número de procesos en ejecución", processes_enabled, NULL)   \
+    X(CONTEXT_CHANGES, gauge, "context_changes", "Cambios de contexto", processes_enabled, NULL)                       \
+    X(SYS_CALLS, counter, "sys_calls", "Número de sys calls", sys_calls_enabled, NULL)                                 \
+    X(BATTERY_LEVEL, gauge, "battery_level", "Nivel de batería", battery_enabled, get_battery_level)                   \
+    X(DISK_READS, gauge, "disk_reads", "Lecturas de disco", disk_io_enabled, NULL)                                     \
+    X(DISK_WRITES, gauge, "disk_writes", "Escrituras de disco", disk_io_enabled, NULL)                                 \
+    X(DISK_IO_INPROGRESS, gauge, "disk_io_inprogress", "Operaciones de disco en progreso", disk_io_enabled, NULL)      \
+    X(NETWORK_TX_DROPS, gauge, "network_tx_drops", "Paquetes transmitidos descartados", network_enabled, NULL)         \
+    X(NETWORK_TX_ERRORS, gauge, "network_tx_errors", "Errores en paquetes transmitidos", network_enabled, NULL)        \
+    X(NETWORK_RX_DROPS, gauge, "network_rx_drops", "Paquetes recibidos descartados", network_enabled, NULL)            \
+    X(NETWORK_RX_ERRORS, gauge, "network_rx_errors", "Errores en paquetes recibidos", network_enabled, NULL)
+
+/** Identificadores de las métricas de la tabla */
+enum metric_id
+{
+#define METRIC_ID(id, type, name, help, enabled, read) METRIC_##id,
+    METRICS_TABLE(METRIC_ID)
+#undef METRIC_ID
+    METRIC_COUNT
+};
+
+/** Descripción de una métrica de la tabla */
+struct metric_desc
+{
+    const char* name;                                                                      /**< Nombre */
+    const char* help;                                                                      /**< Ayuda */
+    prom_metric_t* (*new_fn)(const char*, const char*, size_t, const char**);              /**< Constructor */
+    prom_metric_t* (*new_func_fn)(const char*, const char*, prom_metric_value_fn, void*); /**< Constructor perezoso */
+    const bool* enabled;                                                                   /**< Flag de su colector */
+    double (*read)(void); /**< Lectura al momento de la consulta, negativa si falla, o NULL */
+};
+
+/** Descripciones de las métricas, generadas a partir de la tabla */
+static const struct metric_desc metric_descs[METRIC_COUNT] = {
+#define METRIC_DESC(id, type, name, help, enabled, read)                                                                \
+    [METRIC_##id] = {name, help, prom_##type##_new, prom_##type##_new_func, &enabled, read},
+    METRICS_TABLE(METRIC_DESC)
+#undef METRIC_DESC
+};
+
+/** Métricas de Prometheus. Las de los colectores deshabilitados nunca se crean y quedan en NULL */
+static prom_metric_t* metrics[METRIC_COUNT];
+
+/** Si la última lectura de cada métrica falló. Solo el hilo del servidor HTTP, que atiende las consultas, lo usa */
+static bool read_failed[METRIC_COUNT];
+
+/**
+ * @brief Calcula el valor de una métrica que se lee al momento de la consulta. Cada racha de lecturas fallidas se
+ * informa una sola vez por stderr, para no repetir el mensaje en cada consulta.
+ * @param ctx Descripción de la métrica
+ * @param value Valor leído
+ * @return Distinto de cero si la lectura falla, en cuyo caso la métrica se expone sin valor
+ */
+static int read_metric(void* ctx, double* value)
+{
+    const struct metric_desc* desc = ctx;
+    size_t id = (size_t)(desc - metric_descs);
+    *value = desc->read();
+    if (*value < 0)
+    {
+        if (!read_failed[id])
+        {
+            fprintf(stderr, "Error al leer la métrica %s\n", desc->name);
+        }
+        read_failed[id] = true;
+        return 1;
+    }
+    read_failed[id] = false;
+    return 0;
+}
 
 void update_cpu_gauge()
 {
@@ -83,7 +130,7 @@ void update_cpu_gauge()
     if (usage >= 0)
     {
         pthread_mutex_lock(&lock);
-        prom_gauge_set(cpu_usage_metric, usage, NULL);
+        prom_gauge_set(metrics[METRIC_CPU_USAGE], usage, NULL);
         pthread_mutex_unlock(&lock);
     }
     else
@@ -100,15 +147,14 @@ void update_network_gauge()
         return;
     }
 
-    unsigned long rx_errors = network_stats[RX_ERRORS];
-    unsigned long tx_errors = network_stats[TX_ERRORS];
-    unsigned long rx_drops = network_stats[RX_DROPS];
-    unsigned long tx_drops = network_stats[TX_DROPS];
-
-    prom_gauge_set(network_rx_errors_metric, rx_errors, NULL);
-    prom_gauge_set(network_tx_errors_metric, tx_errors, NULL);
-    prom_gauge_set(network_rx_drops_metric, rx_drops, NULL);
-    prom_gauge_set(network_tx_drops_metric, tx_drops, NULL);
+    // Actualizamos las cuatro métricas de red en una sola llamada
+    prom_batch_update_t updates[] = {
+        {metrics[METRIC_NETWORK_RX_ERRORS], NULL, PROM_BATCH_SET, network_stats[RX_ERRORS]},
+        {metrics[METRIC_NETWORK_TX_ERRORS], NULL, PROM_BATCH_SET, network_stats[TX_ERRORS]},
+        {metrics[METRIC_NETWORK_RX_DROPS], NULL, PROM_BATCH_SET, network_stats[RX_DROPS]},
+        {metrics[METRIC_NETWORK_TX_DROPS], NULL, PROM_BATCH_SET, network_stats[TX_DROPS]},
+    };
+    prom_batch_apply(updates, sizeof(updates) / sizeof(updates[0]));
 }
 
 void update_memory_metrics()
@@ -125,9 +171,12 @@ void update_memory_metrics()
     unsigned long used_memory = total_memory - free_memory;
     unsigned long used_memory_percentage = used_memory * 100 / total_memory;
 
-    prom_gauge_set(memory_usage_metric, used_memory_percentage, NULL);
-    prom_gauge_set(memory_used_metric, used_memory, NULL);
-    prom_gauge_set(memory_available_metric, available_memory, NULL);
+    prom_batch_update_t updates[] = {
+        {metrics[METRIC_MEMORY_USAGE], NULL, PROM_BATCH_SET, used_memory_percentage},
+        {metrics[METRIC_MEMORY_USED], NULL, PROM_BATCH_SET, used_memory},
+        {metrics[METRIC_MEMORY_AVAILABLE], NULL, PROM_BATCH_SET, available_memory},
+    };
+    prom_batch_apply(updates, sizeof(updates) / sizeof(updates[0]));
 }
 
 void update_disk_io_gauge()
@@ -137,27 +186,12 @@ void update_disk_io_gauge()
     {
         return;
     }
-    unsigned long reads = disk_io[0];
-    unsigned long writes = disk_io[1];
-    unsigned long ioinprogress = disk_io[2];
-    prom_gauge_set(disk_reads_metric, reads, NULL);
-    prom_gauge_set(disk_writes_metric, writes, NULL);
-    prom_gauge_set(disk_io_inprogress_metric, ioinprogress, NULL);
-}
-
-void update_battery_gauge()
-{
-    double battery_level = get_battery_level();
-    if (battery_level >= 0)
-    {
-        pthread_mutex_lock(&lock);
-        prom_gauge_set(battery_level_metric, battery_level, NULL);
-        pthread_mutex_unlock(&lock);
-    }
-    else
-    {
-        fprintf(stderr, "Error al obtener el nivel de batería\n");
-    }
+    prom_batch_update_t updates[] = {
+        {metrics[METRIC_DISK_READS], NULL, PROM_BATCH_SET, disk_io[READS]},
+        {metrics[METRIC_DISK_WRITES], NULL, PROM_BATCH_SET, disk_io[WRITES]},
+        {metrics[METRIC_DISK_IO_INPROGRESS], NULL, PROM_BATCH_SET, disk_io[IO_IN_PROGRESS]},
+    };
+    prom_batch_apply(updates, sizeof(updates) / sizeof(updates[0]));
 }
 
 void* expose_metrics(void* arg)
@@ -202,161 +236,32 @@ int init_metrics()
         return EXIT_FAILURE;
     }
 
-    // Creamos la métrica para el uso de CPU
-    cpu_usage_metric = prom_gauge_new("cpu_usage_percentage", "Porcentaje de uso de CPU", 0, NULL);
-    if (cpu_usage_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de uso de CPU\n");
-        return EXIT_FAILURE;
-    }
-
-    // Creamos las métrica para el uso de memoria
-    memory_usage_metric = prom_gauge_new("memory_usage_metric", "Porcentaje de memoria en uso", 0, NULL);
-    if (memory_usage_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de en uso\n");
-        return EXIT_FAILURE;
-    }
-    memory_available_metric = prom_gauge_new("memory_available", "Memoria disponible", 0, NULL);
-    if (memory_available_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de memoria disponible\n");
-        return EXIT_FAILURE;
-    }
-    memory_used_metric = prom_gauge_new("memory_used", "Memoria usada", 0, NULL);
-    if (memory_used_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de memoria usada\n");
-        return EXIT_FAILURE;
-    }
-
-    battery_level_metric = prom_gauge_new("battery_level", "Nivel de batería", 0, NULL);
-    if (battery_level_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de nivel de batería\n");
-        return EXIT_FAILURE;
-    }
-
-    sys_calls_metric = prom_counter_new("sys_calls", "Número de sys calls", 0, NULL);
-    if (sys_calls_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de sys calls\n");
-        return EXIT_FAILURE;
-    }
-
-    cpu_temp_metric = prom_gauge_new("cpu_temp", "Temperatura de la CPU", 0, NULL);
-    if (cpu_temp_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de temperatura de la CPU\n");
-        return EXIT_FAILURE;
-    }
-
-    number_of_processes_metric = prom_gauge_new("number_of_processes", "Número de procesos en ejecución", 0, NULL);
-    if (number_of_processes_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de número de procesos en ejecución\n");
-        return EXIT_FAILURE;
-    }
-
-    avg_load_metric = prom_gauge_new("avg_load", "Carga promedio", 0, NULL);
-    if (avg_load_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de carga promedio\n");
-        return EXIT_FAILURE;
-    }
-
-    cpu_speed_metric = prom_gauge_new("cpu_speed", "Velocidad de la CPU", 0, NULL);
-    if (cpu_speed_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de velocidad de la CPU\n");
-        return EXIT_FAILURE;
-    }
-    network_tx_drops_metric = prom_gauge_new("network_tx_drops", "Paquetes transmitidos descartados", 0, NULL);
-    if (network_tx_drops_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de paquetes transmitidos descartados\n");
-        return EXIT_FAILURE;
-    }
-    network_tx_errors_metric = prom_gauge_new("network_tx_errors", "Errores en paquetes transmitidos", 0, NULL);
-    if (network_tx_errors_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de errores en paquetes transmitidos\n");
-        return EXIT_FAILURE;
-    }
-    network_rx_drops_metric = prom_gauge_new("network_rx_drops", "Paquetes recibidos descartados", 0, NULL);
-    if (network_rx_drops_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de paquetes recibidos descartados\n");
-        return EXIT_FAILURE;
-    }
-    network_rx_errors_metric = prom_gauge_new("network_rx_errors", "Errores en paquetes recibidos", 0, NULL);
-    if (network_rx_errors_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de errores en paquetes recibidos\n");
-        return EXIT_FAILURE;
-    }
-    disk_writes_metric = prom_gauge_new("disk_writes", "Escrituras de disco", 0, NULL);
-    if (disk_writes_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de escrituras de disco\n");
-        return EXIT_FAILURE;
-    }
-    disk_reads_metric = prom_gauge_new("disk_reads", "Lecturas de disco", 0, NULL);
-    if (disk_reads_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de lecturas de disco\n");
-        return EXIT_FAILURE;
-    }
-    disk_io_inprogress_metric = prom_gauge_new("disk_io_inprogress", "Operaciones de disco en progreso", 0, NULL);
-    if (disk_io_inprogress_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de operaciones de disco en progreso\n");
-        return EXIT_FAILURE;
-    }
-    context_changes_metric = prom_gauge_new("context_changes", "Cambios de contexto", 0, NULL);
-    if (context_changes_metric == NULL)
-    {
-        fprintf(stderr, "Error al crear la métrica de cambios de contexto\n");
-        return EXIT_FAILURE;
-    }
-    // Registramos las métricas en el registro por defecto
-    if(cpu_enabled){
-        prom_collector_registry_must_register(cpu_usage_metric);
-    }
-    if(memory_enabled){
-        prom_collector_registry_must_register(memory_usage_metric);
-        prom_collector_registry_must_register(memory_used_metric);
-        prom_collector_registry_must_register(memory_available_metric);
-    }
-    if(cpu_speed_enabled){
-        prom_collector_registry_must_register(cpu_speed_metric);
-    }
-    if(avg_load_enabled){
-        prom_collector_registry_must_register(avg_load_metric);
-    }
-    if(cpu_temp_enabled){
-        prom_collector_registry_must_register(cpu_temp_metric);
-    }
-    if(processes_enabled){
-        prom_collector_registry_must_register(number_of_processes_metric);
-        prom_collector_registry_must_register(context_changes_metric);
-    }
-    if(sys_calls_enabled){
-        prom_collector_registry_must_register(sys_calls_metric);
-    }
-    if(battery_enabled){
-        prom_collector_registry_must_register(battery_level_metric);
-    }
-    if(disk_io_enabled){
-        prom_collector_registry_must_register(disk_reads_metric);
-        prom_collector_registry_must_register(disk_writes_metric);
-        prom_collector_registry_must_register(disk_io_inprogress_metric);
-    }
-    if(network_enabled){
-        prom_collector_registry_must_register(network_tx_drops_metric);
-        prom_collector_registry_must_register(network_tx_errors_metric);
-        prom_collector_registry_must_register(network_rx_drops_metric);
-        prom_collector_registry_must_register(network_rx_errors_metric);
+    // Creamos y registramos solo las métricas de los colectores habilitados
+    for (size_t i = 0; i < METRIC_COUNT; i++)
+    {
+        if (!*metric_descs[i].enabled)
+        {
+            continue;
+        }
+        if (metric_descs[i].read != NULL)
+        {
+            // Las fuentes baratas se leen recién cuando Prometheus consulta la métrica
+            metrics[i] = metric_descs[i].new_func_fn(metric_descs[i].name, metric_descs[i].help, read_metric,
+                                                     (void*)&metric_descs[i]);
+        }
+        else
+        {
+            metrics[i] = metric_descs[i].new_fn(metric_descs[i].name, metric_descs[i].help, 0, NULL);
+        }
+        if (metrics[i] == NULL)
+        {
+            fprintf(stderr, "Error al crear la métrica %s\n", metric_descs[i].name);
+            return EXIT_FAILURE;
+        }
+        if (prom_collector_registry_must_register(metrics[i]) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
     }
     return 0;
 }
@@ -373,51 +278,6 @@ int prom_collector_registry_must_register(prom_gauge_t* prom_gauge)
     return EXIT_SUCCESS;
 }
 
-void update_cpu_temp_gauge()
-{
-    double cpu_temp = get_cpu_temp();
-    if (cpu_temp >= 0)
-    {
-        pthread_mutex_lock(&lock);
-        prom_gauge_set(cpu_temp_metric, cpu_temp, NULL);
-        pthread_mutex_unlock(&lock);
-    }
-    else
-    {
-        fprintf(stderr, "Error al obtener la temperatura de la CPU\n");
-    }
-}
-
-void update_cpu_speed_gauge()
-{
-    double cpu_speed = get_cpu_speed();
-    if (cpu_speed >= 0)
-    {
-        pthread_mutex_lock(&lock);
-        prom_gauge_set(cpu_speed_metric, cpu_speed, NULL);
-        pthread_mutex_unlock(&lock);
-    }
-    else
-    {
-        fprintf(stderr, "Error al obtener la velocidad de la CPU\n");
-    }
-}
-
-void update_avg_load_gauge()
-{
-    double avg_load = get_avg_load();
-    if (avg_load >= 0)
-    {
-        pthread_mutex_lock(&lock);
-        prom_gauge_set(avg_load_metric, avg_load, NULL);
-        pthread_mutex_unlock(&lock);
-    }
-    else
-    {
-        fprintf(stderr, "Error al obtener la carga promedio\n");
-    }
-}
-
 void update_processes_gauges()
 {
     unsigned long* processes_info = get_number_of_processes();
@@ -426,11 +286,12 @@ void update_processes_gauges()
         return;
     }
 
-    unsigned long processes = processes_info[0];
-    unsigned long context_switches = processes_info[1];
+    prom_batch_update_t updates[] = {
+        {metrics[METRIC_NUMBER_OF_PROCESSES], NULL, PROM_BATCH_SET, processes_info[PROCESSES]},
+        {metrics[METRIC_CONTEXT_CHANGES], NULL, PROM_BATCH_SET, processes_info[CONTEXT_SWITCHES]},
+    };
     pthread_mutex_lock(&lock);
-    prom_gauge_set(number_of_processes_metric, processes, NULL);
-    prom_gauge_set(context_changes_metric, context_switches, NULL);
+    prom_batch_apply(updates, sizeof(updates) / sizeof(updates[0]));
     pthread_mutex_unlock(&lock);
 }
 void update_sys_calls_gauge()
@@ -439,7 +300,7 @@ void update_sys_calls_gauge()
     if (sys_calls >= 0)
     {
         pthread_mutex_lock(&lock);
-        prom_counter_inc(sys_calls_metric, NULL);
+        prom_counter_inc(metrics[METRIC_SYS_CALLS], NULL);
         pthread_mutex_unlock(&lock);
     }
     else
@@ -140,18 +140,6 @@ int main(int argc, char* argv[])
         if(memory_enabled){
             update_memory_metrics();
         }
-        if(battery_enabled){
-            update_battery_gauge();
-        }
-        if(avg_load_enabled){
-            update_avg_load_gauge();
-        }
-        if(cpu_temp_enabled){
-            update_cpu_temp_gauge();
-        }
-        if(cpu_speed_enabled){
-            update_cpu_speed_gauge();
-        }
         if(processes_enabled){
             update_processes_gauges();
         }